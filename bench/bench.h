@@ -0,0 +1,96 @@
+#ifndef ECHOSERVER_BENCH_H
+#define ECHOSERVER_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json/src/json.hpp"
+
+#define BENCH_FORMAT_VERSION 1
+
+namespace bench {
+
+    struct Result {
+        std::string name;
+        uint64_t iterations;
+        uint64_t total_ns;
+        uint64_t bytes;
+    };
+
+    class Suite {
+    public:
+        explicit Suite(std::string name) : name(std::move(name)), params(nlohmann::json::object()) {}
+
+        template<typename T>
+        void set_param(const std::string &key, const T &value) {
+            params[key] = value;
+        }
+
+        template<typename Body>
+        void run(const std::string &bench_name, uint64_t iterations, Body &&body) {
+            uint64_t bytes = 0;
+            auto &&start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; ++i) {
+                bytes += body(i);
+            }
+            auto &&elapsed = std::chrono::steady_clock::now() - start;
+            auto &&total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            results.push_back({bench_name, iterations, static_cast<uint64_t>(total_ns), bytes});
+        }
+
+        // Splits the iterations over several threads; the result covers all of them.
+        template<typename Body>
+        void run_parallel(const std::string &bench_name, uint64_t iterations, size_t threads, Body &&body) {
+            std::vector<uint64_t> bytes(threads, 0);
+            std::vector<std::thread> runners;
+            auto &&start = std::chrono::steady_clock::now();
+            for (size_t t = 0; t < threads; ++t) {
+                runners.emplace_back([&, t] {
+                    for (uint64_t i = t; i < iterations; i += threads) {
+                        bytes[t] += body(i);
+                    }
+                });
+            }
+            for (auto &&runner: runners) {
+                runner.join();
+            }
+            auto &&elapsed = std::chrono::steady_clock::now() - start;
+            auto &&total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            uint64_t total_bytes = 0;
+            for (auto &&thread_bytes: bytes) total_bytes += thread_bytes;
+            results.push_back({bench_name, iterations, static_cast<uint64_t>(total_ns), total_bytes});
+        }
+
+        nlohmann::json report() const {
+            nlohmann::json json_results = nlohmann::json::array();
+            for (auto &&result: results) {
+                auto &&iterations = result.iterations == 0 ? 1 : result.iterations;
+                auto &&ns_per_op = static_cast<double>(result.total_ns) / iterations;
+                json_results.push_back({
+                                               {"name",         result.name},
+                                               {"iterations",   result.iterations},
+                                               {"total_ns",     result.total_ns},
+                                               {"ns_per_op",    ns_per_op},
+                                               {"ops_per_sec",  ns_per_op > 0 ? 1e9 / ns_per_op : 0.0},
+                                               {"bytes_per_op", result.bytes / iterations},
+                                       });
+            }
+            return {
+                    {"suite",          name},
+                    {"format_version", BENCH_FORMAT_VERSION},
+                    {"params",         params},
+                    {"results",        json_results},
+            };
+        }
+
+    private:
+        std::string name;
+        nlohmann::json params;
+        std::vector<Result> results;
+    };
+}
+
+#endif //ECHOSERVER_BENCH_H
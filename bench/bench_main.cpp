@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#include "bench.h"
+#include "database/FinanceDb.h"
+#include "database/MemoryStorage.h"
+#include "database/ShardedStorage.h"
+#include "database/ChangeLog.h"
+#include "database/TickBlock.h"
+#include "database/TickImport.h"
+#include "database/TickExport.h"
+#include "logging/logger.h"
+#include "protocol/chunking.h"
+#include "protocol/request.h"
+#include "protocol/handshake.h"
+#include "codec/series_codec.h"
+#include "defines.h"
+#include "sessions.h"
+
+struct BenchConfig {
+    uint64_t currencies = 16;
+    uint64_t values = 256;
+    uint64_t iterations = 1000;
+    uint64_t shards = DEFAULT_SHARDS;
+    uint64_t threads = DEFAULT_SHARDS;
+    uint64_t import_rows = 200000;
+    uint64_t sessions = 1000000;
+    std::string db_path = "finance_bench.db";
+    std::string memory_path = "finance_bench_mem";
+    std::string output;
+};
+
+void usage() {
+    std::cerr << "usage: finance_bench [--currencies=N] [--values=N] [--iterations=N] [--shards=N] [--threads=N]"
+              << " [--import-rows=N] [--sessions=N]"
+              << " [--db=path] [--memory=path]"
+              << " [--output=file]"
+              << std::endl;
+}
+
+bool parse_args(int argc, char **argv, BenchConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        auto &&separator = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || separator == std::string::npos) return false;
+        auto &&key = arg.substr(2, separator - 2);
+        auto &&value = arg.substr(separator + 1);
+        if (key == "currencies") config.currencies = std::stoull(value);
+        else if (key == "values") config.values = std::stoull(value);
+        else if (key == "iterations") config.iterations = std::stoull(value);
+        else if (key == "shards") config.shards = std::stoull(value);
+        else if (key == "threads") config.threads = std::stoull(value);
+        else if (key == "import-rows") config.import_rows = std::stoull(value);
+        else if (key == "sessions") config.sessions = std::stoull(value);
+        else if (key == "db") config.db_path = value;
+        else if (key == "memory") config.memory_path = value;
+        else if (key == "output") config.output = value;
+        else return false;
+    }
+    return config.currencies > 0 && config.iterations > 0 && config.sessions > 0 && config.shards > 0 && config.threads > 0;
+}
+
+std::string currency_name(const std::string &prefix, uint64_t i) {
+    return prefix + std::to_string(i);
+}
+
+void populate(FinanceStorage &database, const BenchConfig &config) {
+    for (uint64_t c = 0; c < config.currencies; ++c) {
+        auto &&currency = currency_name("CUR", c);
+        database.add_currency(currency);
+        for (uint64_t v = 0; v < config.values; ++v) {
+            database.add_currency_value(currency, 1.0 + 0.001 * ((c * 31 + v * 17) % 1000));
+        }
+    }
+}
+
+void database_benches(bench::Suite &suite, FinanceStorage &database, const std::string &prefix,
+                      const BenchConfig &config) {
+    auto &&iterations = config.iterations;
+    uint64_t scan_iterations = std::max<uint64_t>(1, iterations / 100);
+
+    suite.run(prefix + "/add_currency", iterations, [&](uint64_t i) {
+        auto &&currency = currency_name("NEW", i);
+        return database.add_currency(currency) == 0 ? currency.size() : 0;
+    });
+    suite.run(prefix + "/add_currency_value", iterations, [&](uint64_t i) {
+        auto &&currency = currency_name("CUR", i % config.currencies);
+        return database.add_currency_value(currency, 1.0 + 0.0001 * i) == 0 ? sizeof(double) : 0;
+    });
+    suite.run_parallel(prefix + "/parallel_add_currency_value", iterations, config.threads, [&](uint64_t i) {
+        auto &&currency = currency_name("CUR", i % config.currencies);
+        return database.add_currency_value(currency, 1.0 + 0.0001 * i) == 0 ? sizeof(double) : 0;
+    });
+    suite.run(prefix + "/insert", iterations, [&](uint64_t i) {
+        auto &&_time = time(nullptr);
+        FinanceUnit unit{currency_name("INS", i % config.currencies), 1.5, 0.01, 0.015, *std::localtime(&_time)};
+        return database.insert(unit) == 0 ? sizeof(FinanceUnit) : 0;
+    });
+    suite.run(prefix + "/currency_history", iterations, [&](uint64_t i) {
+        auto &&currency = currency_name("CUR", i % config.currencies);
+        std::string response;
+        database.currency_history_json(currency, response);
+        return response.size();
+    });
+    suite.run(prefix + "/currency_list", scan_iterations, [&](uint64_t) {
+        std::string response;
+        database.currency_list_json(response);
+        return response.size();
+    });
+    suite.run(prefix + "/del_currency", iterations, [&](uint64_t i) {
+        auto &&currency = currency_name("NEW", i);
+        return database.del_currency(currency) == 0 ? currency.size() : 0;
+    });
+
+    auto &&maintain_time = static_cast<int64_t>(time(nullptr)) + 2 * BLOCK_WINDOW_SECONDS;
+    suite.run(prefix + "/maintain", 1, [&](uint64_t) {
+        return database.maintain(maintain_time) >= 0 ? 1 : 0;
+    });
+    suite.run(prefix + "/currency_history_maintained", iterations, [&](uint64_t i) {
+        auto &&currency = currency_name("CUR", i % config.currencies);
+        std::vector<FinanceUnit> units;
+        database.currency_history(currency, units);
+        return units.size();
+    });
+}
+
+// Time until a storage engine can serve requests: the SQLite engine rebuilding its quote
+// cache from the table, the same engine starting from its saved cache, and the memory
+// engine mapping its snapshot.
+void startup_benches(bench::Suite &suite, const BenchConfig &config) {
+    uint64_t iterations = std::max<uint64_t>(1, config.iterations / 100);
+    std::vector<std::unique_ptr<FinanceStorage>> opened;
+    suite.run("startup/sqlite_scratch", iterations, [&](uint64_t) {
+        std::remove((config.db_path + QUOTES_SUFFIX).c_str());
+        opened.push_back(std::make_unique<FinanceDb>(config.db_path));
+        return static_cast<size_t>(0);
+    });
+    opened.clear();
+    suite.run("startup/sqlite_snapshot", iterations, [&](uint64_t) {
+        opened.push_back(std::make_unique<FinanceDb>(config.db_path));
+        return static_cast<size_t>(0);
+    });
+    opened.clear();
+    suite.run("startup/memory_snapshot", 1, [&](uint64_t) {
+        opened.push_back(std::make_unique<MemoryStorage>(config.memory_path));
+        return static_cast<size_t>(0);
+    });
+}
+
+// Counts what the legacy session map allocates.
+size_t legacy_allocated = 0;
+
+template<typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+
+    template<typename U>
+    explicit CountingAllocator(const CountingAllocator<U> &) {}
+
+    T *allocate(size_t count) {
+        legacy_allocated += count * sizeof(T);
+        return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T *pointer, size_t count) {
+        legacy_allocated -= count * sizeof(T);
+        ::operator delete(pointer);
+    }
+
+    template<typename U>
+    bool operator==(const CountingAllocator<U> &) const { return true; }
+
+    template<typename U>
+    bool operator!=(const CountingAllocator<U> &) const { return false; }
+};
+
+// The per client state the server kept before sessions.h, with the sockaddr_in as raw bytes.
+struct LegacySession {
+    int64_t descriptor;
+    int timer;
+    int32_t chunk_size;
+    std::vector<std::string> send_buffer;
+    std::vector<std::string> receive_buffer;
+    std::string ip_str;
+    char ip_addr[16];
+};
+
+uint32_t session_address(uint64_t i) {
+    return static_cast<uint32_t>(0x0a000000u + i / 8);
+}
+
+uint16_t session_port(uint64_t i) {
+    return static_cast<uint16_t>(40000 + i % 8);
+}
+
+void session_benches(bench::Suite &suite, const BenchConfig &config) {
+    auto &&count = config.sessions;
+    server::SessionTable sessions;
+    suite.run("sessions/open", count, [&](uint64_t i) {
+        auto created = false;
+        sessions.open(session_address(i), session_port(i), UDP_PACKET_SIZE, created);
+        return static_cast<size_t>(0);
+    });
+    suite.set_param("session_bytes_idle", static_cast<uint64_t>(sessions.memory_usage() / count));
+    suite.run("sessions/lookup", config.iterations * 100, [&](uint64_t i) {
+        auto &&session = i * 7919 % count;
+        return static_cast<size_t>(sessions.find(server::session_id(session_address(session), session_port(session))));
+    });
+    suite.run("sessions/attach_buffers", config.iterations * 100, [&](uint64_t i) {
+        auto &&slot = static_cast<uint32_t>(i * 7919 % count);
+        sessions.attach_buffers(slot)->receive_buffer.emplace_back("chunk");
+        sessions.buffers(slot)->receive_buffer.clear();
+        sessions.release_buffers(slot);
+        return static_cast<size_t>(0);
+    });
+
+    // What the server does for a packet from a spoofed source: a missed lookup and a cookie reply.
+    protocol::CookieKey key{0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull};
+    auto &&epoch = protocol::cookie_epoch(1500000000);
+    suite.run("sessions/unknown_peer", config.iterations * 100, [&](uint64_t i) {
+        auto &&address = static_cast<uint32_t>(0xc0a80000u + i);
+        auto &&port = static_cast<uint16_t>(i);
+        if (sessions.find(server::session_id(address, port)) != SESSION_NONE) return static_cast<size_t>(0);
+        return protocol::cookie_packet(key, address, port, epoch).size();
+    });
+    auto &&cookie = protocol::cookie_packet(key, session_address(0), session_port(0), epoch);
+    suite.run("sessions/check_cookie", config.iterations * 100, [&](uint64_t) {
+        return static_cast<size_t>(protocol::check_cookie(key, cookie.data(), cookie.size(), session_address(0),
+                                                          session_port(0), epoch));
+    });
+
+    using LegacyMap = std::unordered_map<int64_t, LegacySession, std::hash<int64_t>, std::equal_to<>,
+            CountingAllocator<std::pair<const int64_t, LegacySession>>>;
+    {
+        LegacyMap legacy;
+        size_t before = legacy_allocated;
+        suite.run("sessions/legacy_open", count, [&](uint64_t i) {
+            auto &&id = server::session_id(session_address(i), session_port(i));
+            auto &&session = legacy[id];
+            session.descriptor = id;
+            session.chunk_size = UDP_PACKET_SIZE;
+            session.ip_str = "10.0.0." + std::to_string(i % 256);
+            return static_cast<size_t>(0);
+        });
+        suite.set_param("legacy_session_bytes_idle",
+                        static_cast<uint64_t>((legacy_allocated - before) / count));
+    }
+}
+
+void import_benches(bench::Suite &suite, const BenchConfig &config) {
+    auto &&import_path = config.db_path + ".import";
+    auto &&csv_path = import_path + ".csv";
+    auto &&tick_path = import_path + ".ticks";
+    {
+        std::ofstream csv(csv_path);
+        std::ofstream ticks(tick_path, std::ios::binary);
+        uint32_t header[] = {IMPORT_MAGIC, IMPORT_VERSION};
+        ticks.write(reinterpret_cast<const char *>(header), sizeof(header));
+        for (uint64_t i = 0; i < config.import_rows; ++i) {
+            auto &&currency = currency_name("IMP", i % config.currencies);
+            auto &&timestamp = static_cast<int64_t>(1500000000 + i / config.currencies);
+            auto &&value = 1.0 + 0.001 * (i % 1000);
+            csv << currency << ',' << timestamp << ',' << value << '\n';
+            ImportRecord record{};
+            std::memcpy(record.currency, currency.data(), std::min<size_t>(currency.size(), IMPORT_CURRENCY_SIZE));
+            record.timestamp = timestamp;
+            record.value = value;
+            ticks.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+    }
+    for (auto &&input: {csv_path, tick_path}) {
+        auto &&format = input == csv_path ? "csv" : "binary";
+        FinanceDb::reset(import_path);
+        ImportStats stats;
+        suite.run(std::string("import/") + format, 1, [&](uint64_t) {
+            import_ticks(import_path, input, stats);
+            return stats.rows;
+        });
+        auto &&total_ms = stats.parse_ms + stats.insert_ms + stats.index_ms;
+        suite.set_param(std::string("import_rows_per_sec_") + format,
+                        total_ms > 0 ? static_cast<int64_t>(stats.rows) * 1000 / total_ms : 0);
+        suite.set_param(std::string("import_parse_ms_") + format, stats.parse_ms);
+        suite.set_param(std::string("import_insert_ms_") + format, stats.insert_ms);
+        suite.set_param(std::string("import_index_ms_") + format, stats.index_ms);
+    }
+    {
+        FinanceDb imported(import_path);
+        for (auto &&format: {EXPORT_FORMAT_CSV, EXPORT_FORMAT_BINARY}) {
+            ExportStats stats;
+            suite.run(std::string("export/") + format, 1, [&](uint64_t) {
+                export_ticks(imported, {}, format, csv_path, stats);
+                return stats.bytes;
+            });
+            suite.set_param(std::string("export_rows_per_sec_") + format,
+                            stats.ms > 0 ? static_cast<int64_t>(stats.rows) * 1000 / stats.ms : 0);
+        }
+    }
+    std::remove(csv_path.c_str());
+    std::remove(tick_path.c_str());
+    std::remove(import_path.c_str());
+    std::remove((import_path + QUOTES_SUFFIX).c_str());
+}
+
+void framing_benches(bench::Suite &suite, FinanceStorage &database, const BenchConfig &config) {
+    auto &&currency = currency_name("CUR", 0);
+    std::string message = JSON_PREFIX;
+    database.currency_history_json(currency, message);
+    message.append(MESSAGE_END);
+    suite.set_param("framing_message_bytes", message.size());
+
+    std::vector<std::string> chunks;
+    std::vector<protocol::SegmentBatch> batches;
+    for (auto &&chunk_size: {UDP_PACKET_SIZE, PATH_CHUNK_SIZE, MAX_CHUNK_SIZE}) {
+        auto &&suffix = std::to_string(chunk_size);
+        suite.run("framing/split_message_" + suffix, config.iterations, [&](uint64_t) {
+            protocol::split_message(message, chunk_size, 1, chunks);
+            return message.size();
+        });
+        suite.run("framing/segment_batches_" + suffix, config.iterations, [&](uint64_t) {
+            protocol::segment_batches(chunks, batches);
+            return message.size();
+        });
+        suite.set_param("framing_chunks_" + suffix, chunks.size());
+        suite.set_param("framing_send_calls_" + suffix, batches.size());
+    }
+
+    protocol::split_message(message, UDP_PACKET_SIZE, 1, chunks);
+    std::vector<std::string> receive_buffer;
+    suite.run("framing/reassemble", config.iterations, [&](uint64_t) {
+        size_t received = 0;
+        for (auto &&packet: chunks) {
+            protocol::ChunkHeader header{};
+            std::string_view payload;
+            if (!protocol::parse_packet(packet.data(), packet.size(), header, payload)) return received;
+            auto &&status = protocol::add_chunk(receive_buffer, header.number, header.total, payload);
+            if (status == protocol::ChunkStatus::COMPLETE) {
+                auto &&joined = protocol::join_chunks(receive_buffer);
+                received = joined.find(MESSAGE_END);
+            }
+        }
+        return received;
+    });
+}
+
+void json_benches(bench::Suite &suite, FinanceStorage &database, const BenchConfig &config) {
+    std::vector<std::string> requests = {
+            R"({"type":"ADD_CURRENCY","currency":"USD"})",
+            R"({"type":"ADD_CURRENCY_VALUE","currency":"USD","value":63.2475})",
+            R"({"type":"DEL_CURRENCY","currency":"USD"})",
+            R"({"type":"GET_CURRENCY_HISTORY","currency":"USD"})",
+    };
+    suite.run("json/parse_request", config.iterations, [&](uint64_t i) {
+        auto &&json_string = requests[i % requests.size()];
+        protocol::Request request;
+        return protocol::parse_request(json_string, request) == 0 ? json_string.size() : 0;
+    });
+    suite.run("json/parse_request_dom", config.iterations, [&](uint64_t i) {
+        auto &&json_string = requests[i % requests.size()];
+        auto &&request_json = nlohmann::json::parse(json_string);
+        return request_json.size() > 0 ? json_string.size() : 0;
+    });
+
+    auto &&currency = currency_name("CUR", 0);
+    std::vector<FinanceUnit> history_units;
+    database.currency_history(currency, history_units);
+    suite.run("json/serialize_history", config.iterations, [&](uint64_t) {
+        std::string response = JSON_PREFIX;
+        history_json(currency, history_units, response);
+        response.append(MESSAGE_END);
+        return response.size();
+    });
+    suite.run("json/serialize_history_dom", config.iterations, [&](uint64_t) {
+        nlohmann::json history;
+        for (auto &&unit: history_units) {
+            history.push_back({{"value", unit.value}, {"date", format_date(unit.date)}});
+        }
+        nlohmann::json json = {{"currency", currency}, {"history", history}};
+        auto &&response = JSON_PREFIX + json.dump() + MESSAGE_END;
+        return response.size();
+    });
+
+    std::vector<FinanceUnit> list_units;
+    database.currency_list(list_units);
+    suite.run("json/serialize_list", std::max<uint64_t>(1, config.iterations / 100), [&](uint64_t) {
+        std::string response = JSON_PREFIX;
+        list_json(list_units, response);
+        response.append(MESSAGE_END);
+        return response.size();
+    });
+    suite.run("json/serialize_list_dom", std::max<uint64_t>(1, config.iterations / 100), [&](uint64_t) {
+        nlohmann::json list;
+        for (auto &&unit: list_units) {
+            list.push_back({{"currency", unit.currency}, {"value", unit.value}, {"relative_increase", unit.inc_rel},
+                            {"absolute_increase", unit.inc_abs}, {"date", format_date(unit.date)}});
+        }
+        auto &&response = JSON_PREFIX + list.dump() + MESSAGE_END;
+        return response.size();
+    });
+}
+
+void codec_benches(bench::Suite &suite, FinanceStorage &database, const BenchConfig &config) {
+    auto &&currency = currency_name("CUR", 0);
+    std::vector<FinanceUnit> history_units;
+    database.currency_history(currency, history_units);
+    auto &&history = units_to_series(history_units);
+    std::string json_message = JSON_PREFIX;
+    history_json(currency, history_units, json_message);
+    json_message.append(MESSAGE_END);
+    auto &&compact_message = codec::series_message(history, false);
+    std::vector<std::string> chunks;
+    protocol::split_message(compact_message, UDP_PACKET_SIZE, 1, chunks);
+    suite.set_param("history_json_bytes", json_message.size());
+    suite.set_param("history_compact_bytes", compact_message.size());
+    suite.set_param("history_compact_chunks", chunks.size());
+
+    suite.run("codec/encode_history", config.iterations, [&](uint64_t) {
+        return codec::series_message(history, false).size();
+    });
+    suite.run("codec/decode_history", config.iterations, [&](uint64_t) {
+        std::vector<codec::Series> decoded;
+        auto &&payload = std::string_view(compact_message).substr(MESSAGE_PREFIX_LEN);
+        return codec::parse_series_message(payload, decoded) ? decoded[0].ticks.size() : 0;
+    });
+
+    std::vector<FinanceUnit> list_units;
+    database.currency_list(list_units);
+    auto &&list = units_to_series(list_units);
+    std::string list_message;
+    list_json(list_units, list_message);
+    suite.set_param("list_json_bytes", list_message.size() + MESSAGE_PREFIX_LEN + 4);
+    suite.set_param("list_compact_bytes", codec::series_message(list, true).size());
+    suite.run("codec/encode_list", std::max<uint64_t>(1, config.iterations / 100), [&](uint64_t) {
+        return codec::series_message(list, true).size();
+    });
+}
+
+// Ten second ticks spread over the currencies, compacted with tiers scaled to the span they cover.
+void retention_benches(bench::Suite &suite, const BenchConfig &config) {
+    auto &&retention_path = config.db_path + ".retention";
+    auto &&tick_path = retention_path + ".ticks";
+    auto &&per_currency = static_cast<int64_t>(config.import_rows / config.currencies);
+    auto &&now = static_cast<int64_t>(1500000000) + per_currency * 10;
+    {
+        std::ofstream ticks(tick_path, std::ios::binary);
+        uint32_t header[] = {IMPORT_MAGIC, IMPORT_VERSION};
+        ticks.write(reinterpret_cast<const char *>(header), sizeof(header));
+        for (uint64_t i = 0; i < config.import_rows; ++i) {
+            auto &&currency = currency_name("RET", i % config.currencies);
+            ImportRecord record{};
+            std::memcpy(record.currency, currency.data(), std::min<size_t>(currency.size(), IMPORT_CURRENCY_SIZE));
+            record.timestamp = 1500000000 + static_cast<int64_t>(i / config.currencies) * 10;
+            record.value = 1.0 + 0.001 * (i % 1000);
+            ticks.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+    }
+    FinanceDb::reset(retention_path);
+    ImportStats stats;
+    import_ticks(retention_path, tick_path, stats);
+    {
+        FinanceDb database(retention_path);
+        RetentionPolicy policy;
+        int64_t span_hours = std::max<int64_t>(per_currency * 10 / 3600, 3);
+        parse_retention(std::to_string(span_hours / 3) + "h:60," + std::to_string(span_hours * 2 / 3) + "h:3600",
+                        policy);
+        database.set_retention(policy);
+        suite.run("retention/seal", 1, [&](uint64_t) {
+            return static_cast<size_t>(database.seal_blocks(BLOCK_WINDOW_SECONDS, now));
+        });
+        std::vector<FinanceUnit> units;
+        database.currency_list(units);
+        suite.set_param("retention_ticks_before", units.size());
+        suite.set_param("retention_file_bytes_before", std::filesystem::file_size(retention_path));
+        suite.run("retention/compact", 1, [&](uint64_t) {
+            return static_cast<size_t>(database.compact(now));
+        });
+        units.clear();
+        database.currency_list(units);
+        suite.set_param("retention_ticks_after", units.size());
+        suite.set_param("retention_file_bytes_after", std::filesystem::file_size(retention_path));
+    }
+    std::remove(tick_path.c_str());
+    std::remove(retention_path.c_str());
+    std::remove((retention_path + QUOTES_SUFFIX).c_str());
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, config)) {
+        usage();
+        return 1;
+    }
+    Logger::logger_inst->set_level(spdlog::level::warn);
+
+    FinanceDb::reset(config.db_path);
+    FinanceDb database(config.db_path);
+    populate(database, config);
+
+    bench::Suite suite("finance_bench");
+    suite.set_param("currencies", config.currencies);
+    suite.set_param("values", config.values);
+    suite.set_param("iterations", config.iterations);
+    suite.set_param("shards", config.shards);
+    suite.set_param("threads", config.threads);
+
+    framing_benches(suite, database, config);
+    json_benches(suite, database, config);
+    codec_benches(suite, database, config);
+    database_benches(suite, database, "db", config);
+
+    MemoryStorage::reset(config.memory_path);
+    {
+        MemoryStorage memory(config.memory_path);
+        populate(memory, config);
+        database_benches(suite, memory, "mem", config);
+    }
+
+    auto &&logged_path = config.memory_path + "_logged";
+    MemoryStorage::reset(logged_path);
+    {
+        ChangeLog logged(std::make_unique<MemoryStorage>(logged_path));
+        populate(logged, config);
+        database_benches(suite, logged, "mem_logged", config);
+        protocol::ChangeBatch batch;
+        suite.run("mem_logged/changes_message", config.iterations, [&](uint64_t i) {
+            logged.changes_since(i % logged.head(), CHANGE_BATCH_LIMIT, batch);
+            return protocol::changes_message(batch).size();
+        });
+    }
+
+    ShardedStorage::reset(config.db_path, config.shards);
+    {
+        ShardedStorage sharded(config.db_path, config.shards);
+        populate(sharded, config);
+        database_benches(suite, sharded, "sharded", config);
+    }
+    startup_benches(suite, config);
+    session_benches(suite, config);
+    import_benches(suite, config);
+    retention_benches(suite, config);
+
+    auto &&report = suite.report().dump(2);
+    if (config.output.empty()) {
+        std::cout << report << std::endl;
+    } else {
+        std::ofstream out(config.output);
+        out << report << std::endl;
+    }
+}
@@ -1,38 +1,12 @@
-#define WIN32_LEAN_AND_MEAN
-
-#include <windows.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-
-#pragma comment (lib, "Ws2_32.lib")
-#pragma comment (lib, "Mswsock.lib")
-#pragma comment (lib, "AdvApi32.lib")
-
+#include <ctime>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include "json/src/json.hpp"
 #include "defines.h"
 #include "client_defs.h"
-
-int receive_from_server(SOCKET server_socket, std::string &received) {
-    char message_buf[MESSAGE_SIZE];
-    while (true) {
-        auto &&count = recv(server_socket, message_buf, MESSAGE_SIZE, 0);
-        if (count == 0) {
-            std::cerr << "socket closed" << std::endl;
-            return -1;
-        }
-        if (count < 0) {
-            std::cerr << "socket error " << WSAGetLastError() << std::endl;
-            return -1;
-        }
-        received.append(message_buf, count);
-        auto &&message_end = received.find(MESSAGE_END);
-        if (message_end != std::string::npos) {
-            received.erase(message_end);
-            return 0;
-        }
-    }
-}
+#include "lib/FinanceClient.h"
 
 std::vector<std::string> split_by_space(std::string &str) {
     std::istringstream buf(str);
@@ -41,16 +15,27 @@ std::vector<std::string> split_by_space(std::string &str) {
     return tokens;
 }
 
+std::string format_series(const std::vector<codec::Series> &series) {
+    std::stringstream out;
+    for (auto &&item: series) {
+        out << item.currency << ":\n";
+        for (auto &&tick: item.ticks) {
+            auto &&time = static_cast<std::time_t>(tick.timestamp);
+            out << "    " << std::put_time(std::localtime(&time), "%Y-%b-%d %H:%M:%S") << " " << tick.value << "\n";
+        }
+    }
+    return out.str();
+}
 
-std::string parse_response(std::string &basic_string) {
-    auto &&response_type = basic_string.substr(0, MESSAGE_PREFIX_LEN);
-    auto &&result = basic_string.substr(MESSAGE_PREFIX_LEN);
-    if (response_type == TXT_PREFIX || response_type == ERROR_PREFIX) {
-        return result;
-    } else if (response_type == JSON_PREFIX) {
-        return nlohmann::json::parse(result).dump(4);
+std::string parse_response(const client::Response &response) {
+    if (response.prefix == JSON_PREFIX) {
+        return nlohmann::json::parse(response.body).dump(4);
+    } else if (response.prefix == BIN_PREFIX) {
+        std::vector<codec::Series> series;
+        if (!response.series(series)) return "Incorrect binary response";
+        return format_series(series);
     }
-    return basic_string;
+    return response.body;
 }
 
 
@@ -59,61 +44,28 @@ std::string help_message() {
     message << "/add [currency] : add new currency\n"
             << "/addv [currency] [value] : add new value to currency\n"
             << "/del [currency] : remove currency\n"
-            << "/all : list all currencies\n"
-            << "/hist [currency] : history for currency";
+            << "/all [compact] : list all currencies\n"
+            << "/hist [currency] [compact] : history for currency";
     return message.str();
 }
 
-int main() {
-
-    WSADATA wsa_data{0};
-
-    auto &&startup_status = WSAStartup(MAKEWORD(2, 2), &wsa_data);
-    if (startup_status != 0) {
-        std::cerr << "WSAStartup failed with error code " << startup_status << std::endl;
+int main(int argc, char **argv) {
+    std::string host = argc > 1 ? argv[1] : CLIENT_DEFAULT_HOST;
+    std::unique_ptr<client::FinanceClient> finance_client;
+    try {
+        finance_client = std::make_unique<client::FinanceClient>(host, SERVER_PORT, 1);
+    } catch (std::exception &ex) {
+        std::cerr << ex.what() << std::endl;
         std::exit(1);
     }
 
-    addrinfo *result = nullptr;
-    addrinfo hints{};
-    ZeroMemory(&hints, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-
-    auto &&getaddr_status = getaddrinfo("192.168.1.73", "7777", &hints, &result);
-    if (getaddr_status != 0) {
-        std::cerr << "Getaddr failed with status " << getaddr_status << std::endl;
-        WSACleanup();
-        std::exit(2);
-    }
-
-    auto &&server_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
-    if (server_socket == INVALID_SOCKET) {
-        std::cerr << "Socket creation failed with status " << WSAGetLastError() << std::endl;
-        WSACleanup();
-        std::exit(3);
-    }
-
-    auto &&connect_status = connect(server_socket, result->ai_addr, static_cast<int>(result->ai_addrlen));
-    if (connect_status == SOCKET_ERROR) {
-        std::cerr << "Connection to server failed with status " << WSAGetLastError() << std::endl;
-        WSACleanup();
-        std::exit(4);
-    }
-    freeaddrinfo(result);
-
     std::string in_str;
-    std::string received;
-    std::string to_send;
-
     while (true) {
         in_str.clear();
-        to_send.clear();
-        received.clear();
         std::cout << "Enter message: " << std::endl;
-        std::getline(std::cin, in_str);
-        if (in_str[0] == '/') {
+        if (!std::getline(std::cin, in_str)) break;
+        std::future<client::Response> pending;
+        if (!in_str.empty() && in_str[0] == '/') {
             auto &&cleaned = in_str.substr(1);
             auto &&tokens = split_by_space(cleaned);
             if (tokens.empty()) {
@@ -127,55 +79,42 @@ int main() {
                 continue;
             }
 
-            if (cmd == ADD_CURRENCY_CMD ||
-                cmd == DEL_CURRENCY_CMD ||
-                cmd == HISTORY_CURRENCY_CMD) {
+            if (cmd == ADD_CURRENCY_CMD || cmd == DEL_CURRENCY_CMD) {
                 if (tokens.size() != 2) {
                     std::cerr << "Invalid command arguments" << std::endl;
                     continue;
                 }
-                auto &&currency = tokens[1];
-                nlohmann::json request_json = {
-                        {"currency", currency}
-                };
-                if (cmd == ADD_CURRENCY_CMD) request_json["type"] = REQUEST_ADD_CURRENCY;
-                else if (cmd == DEL_CURRENCY_CMD) request_json["type"] = REQUEST_DEL_CURRENCY;
-                else if (cmd == HISTORY_CURRENCY_CMD) request_json["type"] = REQUEST_GET_CURRENCY_HISTORY;
-                else continue;
-                to_send = JSON_PREFIX + request_json.dump() + MESSAGE_END;
+                if (cmd == ADD_CURRENCY_CMD) pending = finance_client->add_currency(tokens[1]);
+                else pending = finance_client->del_currency(tokens[1]);
+            } else if (cmd == HISTORY_CURRENCY_CMD) {
+                if (tokens.size() < 2 || tokens.size() > 3) {
+                    std::cerr << "Invalid command arguments" << std::endl;
+                    continue;
+                }
+                auto &&compact = tokens.size() == 3 && tokens[2] == ENCODING_COMPACT;
+                pending = finance_client->currency_history(tokens[1], compact);
             } else if (cmd == ADD_CURRENCY_VALUE_CMD) {
                 if (tokens.size() != 3) {
                     std::cerr << "Invalid command arguments" << std::endl;
                     continue;
                 }
-                auto &&currency = tokens[1];
                 auto &&value = strtod(tokens[2].data(), nullptr);
-                nlohmann::json request_json = {
-                        {"type", REQUEST_ADD_CURRENCY_VALUE},
-                        {"currency", currency},
-                        {"value",    value}
-                };
-                to_send = JSON_PREFIX + request_json.dump() + MESSAGE_END;
-
+                pending = finance_client->add_currency_value(tokens[1], value);
             } else if (cmd == LIST_CURRENCIES_CMD) {
-                to_send = CMD_PREFIX + std::string(REQUEST_GET_ALL_CURRENCIES) + MESSAGE_END;
+                auto &&compact = tokens.size() == 2 && tokens[1] == ENCODING_COMPACT;
+                pending = finance_client->list_currencies(compact);
             } else {
-                to_send = CMD_PREFIX + cmd + MESSAGE_END;
+                pending = finance_client->send_command(cmd);
             }
         } else {
-            to_send = TXT_PREFIX + in_str + MESSAGE_END;
-        }
-        if (send(server_socket, to_send.c_str(), to_send.length(), 0) == -1) {
-            std::cerr << "Error in send" << std::endl;
-            break;
+            pending = finance_client->send_text(in_str);
         }
         std::cout << "Sent: " << in_str << std::endl;
-        auto &&receive_code = receive_from_server(server_socket, received);
-        if (receive_code < 0) break;
-        auto &&response = parse_response(received);
-        std::cout << "Received: " << response << std::endl;
+        try {
+            auto &&response = pending.get();
+            std::cout << "Received: " << parse_response(response) << std::endl;
+        } catch (std::exception &ex) {
+            std::cerr << ex.what() << std::endl;
+        }
     }
-
-    closesocket(server_socket);
-    WSACleanup();
-}
\ No newline at end of file
+}
@@ -5,3 +5,5 @@
 #define DEL_CURRENCY_CMD "del"
 #define LIST_CURRENCIES_CMD "all"
 #define HISTORY_CURRENCY_CMD "hist"
+
+#define CLIENT_DEFAULT_HOST "127.0.0.1"
@@ -0,0 +1,460 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define poll WSAPoll
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define close_socket close
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "FinanceClient.h"
+#include "protocol/chunking.h"
+#include "protocol/handshake.h"
+#include "json/src/json.hpp"
+
+namespace {
+    void set_nonblocking(client::socket_t socket) {
+#ifdef _WIN32
+        u_long mode = 1;
+        ioctlsocket(socket, FIONBIO, &mode);
+#else
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    }
+
+    client::socket_t connected_socket(const sockaddr_in &address) {
+        auto &&socket_d = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+#ifdef _WIN32
+        if (socket_d == INVALID_SOCKET) throw std::runtime_error("Error in socket creation");
+#else
+        if (socket_d < 0) throw std::runtime_error("Error in socket creation");
+#endif
+        auto &&connect_status = connect(socket_d, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+        if (connect_status != 0) {
+            close_socket(socket_d);
+            throw std::runtime_error("Error in socket connect");
+        }
+        set_nonblocking(socket_d);
+#if defined(__linux__) && defined(UDP_GRO)
+        int gro = 1;
+        setsockopt(socket_d, SOL_UDP, UDP_GRO, &gro, sizeof(gro));
+#endif
+        return static_cast<client::socket_t>(socket_d);
+    }
+
+    bool segmentation_supported(client::socket_t socket) {
+#if defined(__linux__) && defined(UDP_SEGMENT)
+        int segment_size = 0;
+        socklen_t option_size = sizeof(segment_size);
+        return getsockopt(socket, SOL_UDP, UDP_SEGMENT, &segment_size, &option_size) == 0;
+#else
+        return false;
+#endif
+    }
+
+    sockaddr_in resolve(const std::string &host, uint16_t port) {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo *result = nullptr;
+        auto &&status = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+        if (status != 0 || result == nullptr) throw std::runtime_error("Cannot resolve " + host);
+        sockaddr_in address{};
+        std::memcpy(&address, result->ai_addr, sizeof(address));
+        freeaddrinfo(result);
+        return address;
+    }
+
+    std::string json_request(const nlohmann::json &request_json) {
+        return JSON_PREFIX + request_json.dump() + MESSAGE_END;
+    }
+}
+
+bool client::Response::series(std::vector<codec::Series> &series) const {
+    return prefix == BIN_PREFIX && codec::parse_series_message(body, series);
+}
+
+client::Response client::parse_response(std::string_view message) {
+    Response response;
+    if (message.size() < MESSAGE_PREFIX_LEN) {
+        response.body = std::string(message);
+        return response;
+    }
+    response.prefix = std::string(message.substr(0, MESSAGE_PREFIX_LEN));
+    message.remove_prefix(MESSAGE_PREFIX_LEN);
+    if (response.prefix != BIN_PREFIX) {
+        auto &&message_end = message.find(MESSAGE_END);
+        if (message_end != std::string_view::npos) message = message.substr(0, message_end);
+    }
+    response.body = std::string(message);
+    return response;
+}
+
+client::FinanceClient::FinanceClient(const std::string &host, uint16_t port, size_t channel_count,
+                                     int32_t chunk_size) :
+        requested_chunk_size(chunk_size), segmentation_offload(false),
+        wake_receiver(0), wake_sender(0), terminate(false) {
+#ifdef _WIN32
+    WSADATA wsa{};
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) throw std::runtime_error("WSA init failed");
+#endif
+    auto &&server_address = resolve(host, port);
+    for (size_t i = 0; i < channel_count; ++i) {
+        auto &&channel = std::make_unique<Channel>();
+        channel->socket = connected_socket(server_address);
+        channels.emplace_back(std::move(channel));
+    }
+    if (requested_chunk_size <= 0) {
+        auto &&loopback_host = (ntohl(server_address.sin_addr.s_addr) >> 24) == 127;
+        requested_chunk_size = loopback_host ? MAX_CHUNK_SIZE : PATH_CHUNK_SIZE;
+    }
+    segmentation_offload = !channels.empty() && segmentation_supported(channels.front()->socket);
+
+    sockaddr_in loopback{};
+    loopback.sin_family = AF_INET;
+    loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wake_receiver = static_cast<socket_t>(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    socklen_t loopback_size = sizeof(loopback);
+    if (bind(wake_receiver, reinterpret_cast<sockaddr *>(&loopback), sizeof(loopback)) != 0 ||
+        getsockname(wake_receiver, reinterpret_cast<sockaddr *>(&loopback), &loopback_size) != 0) {
+        throw std::runtime_error("Error in wake socket bind");
+    }
+    set_nonblocking(wake_receiver);
+    wake_sender = connected_socket(loopback);
+
+    io_thread = std::thread(&FinanceClient::io_loop, this);
+}
+
+client::FinanceClient::~FinanceClient() {
+    terminate = true;
+    wake();
+    if (io_thread.joinable()) {
+        io_thread.join();
+    }
+    for (auto &&channel: channels) {
+        close_socket(channel->socket);
+    }
+    close_socket(wake_receiver);
+    close_socket(wake_sender);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+std::future<client::Response> client::FinanceClient::add_currency(const std::string &currency) {
+    return request(json_request({{"type", REQUEST_ADD_CURRENCY}, {"currency", currency}}));
+}
+
+std::future<client::Response> client::FinanceClient::add_currency_value(const std::string &currency, double value) {
+    return request(json_request({{"type", REQUEST_ADD_CURRENCY_VALUE}, {"currency", currency}, {"value", value}}));
+}
+
+std::future<client::Response> client::FinanceClient::del_currency(const std::string &currency) {
+    return request(json_request({{"type", REQUEST_DEL_CURRENCY}, {"currency", currency}}));
+}
+
+std::future<client::Response> client::FinanceClient::list_currencies(bool compact) {
+    if (!compact) return send_command(REQUEST_GET_ALL_CURRENCIES);
+    return request(json_request({{"type", REQUEST_GET_ALL_CURRENCIES}, {"encoding", ENCODING_COMPACT}}));
+}
+
+std::future<client::Response> client::FinanceClient::currency_history(const std::string &currency, bool compact) {
+    nlohmann::json request_json = {{"type", REQUEST_GET_CURRENCY_HISTORY}, {"currency", currency}};
+    if (compact) request_json["encoding"] = ENCODING_COMPACT;
+    return request(json_request(request_json));
+}
+
+std::future<client::Response> client::FinanceClient::changes(uint64_t since) {
+    return request(json_request({{"type", REQUEST_GET_CHANGES}, {"since", since}}));
+}
+
+std::future<client::Response> client::FinanceClient::snapshot(const std::string &currency) {
+    nlohmann::json request_json = {{"type", REQUEST_GET_SNAPSHOT}};
+    if (!currency.empty()) request_json["currency"] = currency;
+    return request(json_request(request_json));
+}
+
+std::future<client::Response> client::FinanceClient::start_export(const std::string &name, const std::string &format,
+                                                                  const std::vector<std::string> &currencies) {
+    nlohmann::json request_json = {{"type", REQUEST_EXPORT}, {"name", name}, {"format", format}};
+    if (!currencies.empty()) request_json["currencies"] = currencies;
+    return request(json_request(request_json));
+}
+
+std::future<client::Response> client::FinanceClient::send_text(const std::string &text) {
+    return request(TXT_PREFIX + text + MESSAGE_END);
+}
+
+std::future<client::Response> client::FinanceClient::send_command(const std::string &command) {
+    return request(CMD_PREFIX + command + MESSAGE_END);
+}
+
+std::future<client::Response> client::FinanceClient::request(std::string message) {
+    PendingRequest pending;
+    pending.message = std::move(message);
+    auto future = pending.promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        Channel *target = channels.front().get();
+        for (auto &&channel: channels) {
+            if (channel->queue.size() + channel->active < target->queue.size() + target->active) {
+                target = channel.get();
+            }
+        }
+        target->queue.emplace_back(std::move(pending));
+    }
+    wake();
+    return future;
+}
+
+void client::FinanceClient::wake() {
+    char signal = 1;
+    send(wake_sender, &signal, 1, 0);
+}
+
+void client::FinanceClient::io_loop() {
+    std::vector<pollfd> descriptors(channels.size() + 1);
+    descriptors[0].fd = wake_receiver;
+    descriptors[0].events = POLLIN;
+    for (size_t i = 0; i < channels.size(); ++i) {
+        descriptors[i + 1].fd = channels[i]->socket;
+        descriptors[i + 1].events = POLLIN;
+    }
+    std::vector<char> buffer(MESSAGE_SIZE);
+
+    while (!terminate) {
+        for (auto &&channel: channels) {
+            if (!channel->active) start_next(*channel);
+        }
+        auto &&ready = poll(descriptors.data(), static_cast<unsigned long>(descriptors.size()), CLIENT_POLL_MS);
+        if (ready > 0 && (descriptors[0].revents & POLLIN)) {
+            while (recv(wake_receiver, buffer.data(), static_cast<int>(buffer.size()), 0) > 0);
+        }
+        for (size_t i = 0; ready > 0 && i < channels.size(); ++i) {
+            if ((descriptors[i + 1].revents & POLLIN) == 0) continue;
+            auto &&channel = *channels[i];
+            while (true) {
+                size_t segment_size = 0;
+                auto &&bytes = receive(channel, buffer, segment_size);
+                if (bytes <= 0 || segment_size == 0) break;
+                auto &&received = static_cast<size_t>(bytes);
+                for (size_t offset = 0; offset < received; offset += segment_size) {
+                    auto &&rest = received - offset;
+                    handle_packet(channel, buffer.data() + offset, rest < segment_size ? rest : segment_size);
+                }
+            }
+        }
+        auto &&now = std::chrono::steady_clock::now();
+        for (auto &&channel: channels) {
+            if (channel->active) check_timeout(*channel, now);
+        }
+    }
+
+    for (auto &&channel: channels) {
+        if (channel->active) fail(*channel, "Client stopped");
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        for (auto &&pending: channel->queue) {
+            pending.promise.set_exception(std::make_exception_ptr(std::runtime_error("Client stopped")));
+        }
+        channel->queue.clear();
+    }
+}
+
+void client::FinanceClient::start_next(Channel &channel) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (channel.queue.empty()) return;
+        channel.current = std::move(channel.queue.front());
+        channel.queue.pop_front();
+    }
+    if (channel.established && !channel.chunk_size_agreed) {
+        send_packet(channel, protocol::status_packet(CHUNK_SIZE_MESSAGE, requested_chunk_size));
+    }
+    if (++channel.sequence == 0) channel.sequence = 1;
+    protocol::split_message(channel.current.message, channel.chunk_size, channel.sequence, channel.send_chunks);
+    channel.receive_buffer.clear();
+    channel.acked = false;
+    channel.retries = 0;
+    channel.active = true;
+    channel.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CLIENT_RETRANSMIT_MS);
+    if (!channel.established) {
+        return send_packet(channel, protocol::hello_packet());
+    }
+    send_packets(channel, channel.send_chunks);
+}
+
+void client::FinanceClient::handle_packet(Channel &channel, const char *data, size_t size) {
+    if (size > 0 && data[0] == COOKIE_MESSAGE) {
+        return handle_cookie(channel, data, size);
+    }
+    protocol::ChunkHeader header{};
+    std::string_view payload;
+    if (!protocol::parse_packet(data, size, header, payload)) return;
+    if (header.type == CHUNK_SIZE_MESSAGE) {
+        channel.chunk_size = protocol::negotiate_chunk_size(header.number);
+        channel.chunk_size_agreed = true;
+        return;
+    }
+    if (!channel.active || header.sequence != channel.sequence) return;
+    channel.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CLIENT_RETRANSMIT_MS);
+    if (header.type == CHUNK_SUCCESS_MESSAGE) {
+        if (header.number == static_cast<int32_t>(channel.send_chunks.size())) channel.acked = true;
+        return;
+    }
+    if (header.type == CHUNK_REQUEST_MESSAGE) {
+        if (header.number >= 0 && header.number < static_cast<int32_t>(channel.send_chunks.size())) {
+            send_packet(channel, channel.send_chunks[header.number]);
+        }
+        return;
+    }
+    channel.acked = true;
+    channel.retries = 0;
+    auto &&status = protocol::add_chunk(channel.receive_buffer, header.number, header.total, payload);
+    if (status == protocol::ChunkStatus::MISSING) {
+        auto &&expected = static_cast<int32_t>(channel.receive_buffer.size());
+        send_packet(channel, protocol::status_packet(CHUNK_REQUEST_MESSAGE, expected, channel.sequence));
+    } else if (status == protocol::ChunkStatus::COMPLETE) {
+        send_packet(channel, protocol::status_packet(CHUNK_SUCCESS_MESSAGE, header.total, channel.sequence));
+        auto &&message = protocol::join_chunks(channel.receive_buffer);
+        finish(channel, parse_response(message));
+    }
+}
+
+// Also sent when the server dropped the session, so the chunk size is agreed again and
+// unacknowledged chunks go out once the cookie is echoed.
+void client::FinanceClient::handle_cookie(Channel &channel, const char *data, size_t size) {
+    if (size != COOKIE_PACKET_SIZE) return;
+    send_packet(channel, std::string_view(data, size));
+    channel.established = true;
+    channel.chunk_size_agreed = false;
+    send_packet(channel, protocol::status_packet(CHUNK_SIZE_MESSAGE, requested_chunk_size));
+    if (channel.active && !channel.acked) {
+        channel.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CLIENT_RETRANSMIT_MS);
+        send_packets(channel, channel.send_chunks);
+    }
+}
+
+void client::FinanceClient::check_timeout(Channel &channel, std::chrono::steady_clock::time_point now) {
+    if (now < channel.deadline) return;
+    if (++channel.retries > CLIENT_MAX_RETRIES) {
+        return fail(channel, "Request timed out");
+    }
+    channel.deadline = now + std::chrono::milliseconds(CLIENT_RETRANSMIT_MS);
+    if (!channel.established) {
+        return send_packet(channel, protocol::hello_packet());
+    }
+    if (!channel.acked) {
+        return send_packets(channel, channel.send_chunks);
+    }
+    auto &&expected = static_cast<int32_t>(channel.receive_buffer.size());
+    send_packet(channel, protocol::status_packet(CHUNK_REQUEST_MESSAGE, expected, channel.sequence));
+}
+
+void client::FinanceClient::finish(Channel &channel, Response response) {
+    channel.active = false;
+    channel.current.promise.set_value(std::move(response));
+    start_next(channel);
+}
+
+void client::FinanceClient::fail(Channel &channel, const std::string &reason) {
+    channel.active = false;
+    channel.current.promise.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+}
+
+int client::FinanceClient::receive(Channel &channel, std::vector<char> &buffer, size_t &segment_size) {
+#if defined(__linux__) && defined(UDP_GRO)
+    iovec vector{buffer.data(), buffer.size()};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    auto &&bytes = recvmsg(channel.socket, &message, 0);
+    segment_size = bytes > 0 ? static_cast<size_t>(bytes) : 0;
+    for (auto cmsg = CMSG_FIRSTHDR(&message); bytes > 0 && cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gro_size;
+            std::memcpy(&gro_size, CMSG_DATA(cmsg), sizeof(gro_size));
+            if (gro_size > 0) segment_size = static_cast<size_t>(gro_size);
+        }
+    }
+    return static_cast<int>(bytes);
+#else
+    auto &&bytes = recv(channel.socket, buffer.data(), static_cast<int>(buffer.size()), 0);
+    segment_size = bytes > 0 ? static_cast<size_t>(bytes) : 0;
+    return static_cast<int>(bytes);
+#endif
+}
+
+// One sendmsg per batch of equally sized chunks, the kernel cuts it into datagrams.
+bool client::FinanceClient::send_segmented(Channel &channel, const std::vector<std::string> &packets) {
+#if defined(__linux__) && defined(UDP_SEGMENT)
+    std::vector<protocol::SegmentBatch> batches;
+    protocol::segment_batches(packets, batches);
+    for (auto &&batch: batches) {
+        iovec vector{const_cast<char *>(batch.data.data()), batch.data.size()};
+        char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+        msghdr message{};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        auto cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        auto &&segment_size = static_cast<uint16_t>(batch.segment_size);
+        std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+        if (sendmsg(channel.socket, &message, 0) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            segmentation_offload = false;
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void client::FinanceClient::send_packets(Channel &channel, const std::vector<std::string> &packets) {
+    if (segmentation_offload && packets.size() > 1 && send_segmented(channel, packets)) return;
+#ifdef __linux__
+    std::vector<iovec> vectors(packets.size());
+    std::vector<mmsghdr> messages(packets.size());
+    for (size_t i = 0; i < packets.size(); ++i) {
+        vectors[i].iov_base = const_cast<char *>(packets[i].data());
+        vectors[i].iov_len = packets[i].size();
+        messages[i] = mmsghdr{};
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t sent = 0;
+    while (sent < messages.size()) {
+        auto &&count = sendmmsg(channel.socket, messages.data() + sent, static_cast<unsigned>(messages.size() - sent), 0);
+        if (count <= 0) break;
+        sent += static_cast<size_t>(count);
+    }
+#else
+    for (auto &&packet: packets) {
+        send_packet(channel, packet);
+    }
+#endif
+}
+
+void client::FinanceClient::send_packet(Channel &channel, std::string_view packet) {
+    send(channel.socket, packet.data(), static_cast<int>(packet.size()), 0);
+}
@@ -0,0 +1,144 @@
+#ifndef ECHOSERVER_FINANCE_CLIENT_H
+#define ECHOSERVER_FINANCE_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "defines.h"
+#include "codec/series_codec.h"
+
+#define CLIENT_CHANNELS 4
+#define CLIENT_RETRANSMIT_MS 200
+#define CLIENT_MAX_RETRIES 10
+#define CLIENT_POLL_MS 50
+
+namespace client {
+
+#ifdef _WIN32
+    using socket_t = uintptr_t;
+#else
+    using socket_t = int;
+#endif
+
+    struct Response {
+        std::string prefix;
+        std::string body;
+
+        bool is_error() const {
+            return prefix == ERROR_PREFIX;
+        }
+
+        bool series(std::vector<codec::Series> &series) const;
+    };
+
+    Response parse_response(std::string_view message);
+
+    struct PendingRequest {
+        std::string message;
+        std::promise<Response> promise;
+    };
+
+    struct Channel {
+        socket_t socket = 0;
+        std::deque<PendingRequest> queue;
+        bool active = false;
+        PendingRequest current;
+        std::vector<std::string> send_chunks;
+        std::vector<std::string> receive_buffer;
+        bool acked = false;
+        uint16_t sequence = 0;
+        int retries = 0;
+        int32_t chunk_size = UDP_PACKET_SIZE;
+        bool chunk_size_agreed = false;
+        bool established = false;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    // Requests are spread over several UDP sockets, one server session each, and every
+    // session carries one request at a time. A request whose chunks are never acknowledged
+    // is sent again. Requests of a channel are numbered, never with 0, and the server echoes
+    // the number in its answer and answers a repeated request from its last reply instead of
+    // running it again; packets for an earlier request are dropped.
+    // A session starts with a hello that the server answers with a cookie, and the server
+    // keeps no state for the socket until the cookie is echoed back.
+    // A chunk_size of 0 asks for a jumbo chunk on loopback and PATH_CHUNK_SIZE otherwise.
+    class FinanceClient {
+    public:
+        explicit FinanceClient(const std::string &host, uint16_t port = SERVER_PORT,
+                               size_t channel_count = CLIENT_CHANNELS, int32_t chunk_size = 0);
+
+        ~FinanceClient();
+
+        FinanceClient(const FinanceClient &) = delete;
+
+        FinanceClient &operator=(const FinanceClient &) = delete;
+
+        std::future<Response> add_currency(const std::string &currency);
+
+        std::future<Response> add_currency_value(const std::string &currency, double value);
+
+        std::future<Response> del_currency(const std::string &currency);
+
+        std::future<Response> list_currencies(bool compact = false);
+
+        std::future<Response> currency_history(const std::string &currency, bool compact = false);
+
+        std::future<Response> changes(uint64_t since);
+
+        std::future<Response> snapshot(const std::string &currency = "");
+
+        // format is "csv" or "binary"; the server writes the file under its export directory.
+        std::future<Response> start_export(const std::string &name, const std::string &format = "csv",
+                                           const std::vector<std::string> &currencies = {});
+
+        std::future<Response> send_text(const std::string &text);
+
+        std::future<Response> send_command(const std::string &command);
+
+        std::future<Response> request(std::string message);
+
+    private:
+        void io_loop();
+
+        void start_next(Channel &channel);
+
+        void handle_packet(Channel &channel, const char *data, size_t size);
+
+        void handle_cookie(Channel &channel, const char *data, size_t size);
+
+        void check_timeout(Channel &channel, std::chrono::steady_clock::time_point now);
+
+        void finish(Channel &channel, Response response);
+
+        void fail(Channel &channel, const std::string &reason);
+
+        int receive(Channel &channel, std::vector<char> &buffer, size_t &segment_size);
+
+        void send_packets(Channel &channel, const std::vector<std::string> &packets);
+
+        bool send_segmented(Channel &channel, const std::vector<std::string> &packets);
+
+        void send_packet(Channel &channel, std::string_view packet);
+
+        void wake();
+
+        std::vector<std::unique_ptr<Channel>> channels;
+        int32_t requested_chunk_size;
+        bool segmentation_offload;
+        socket_t wake_receiver;
+        socket_t wake_sender;
+        std::mutex queue_mutex;
+        std::atomic_bool terminate;
+        std::thread io_thread;
+    };
+}
+
+#endif
@@ -0,0 +1,335 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define poll WSAPoll
+#define close_socket closesocket
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define close_socket close
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "json/src/json.hpp"
+#include "defines.h"
+#include "protocol/capture.h"
+#include "protocol/chunking.h"
+#include "protocol/handshake.h"
+
+#define REPLAY_HANDSHAKE_MS 500
+#define REPLAY_HANDSHAKE_RETRIES 4
+#define REPLAY_DRAIN_MS 2000
+
+#ifdef _WIN32
+using socket_t = SOCKET;
+#else
+using socket_t = int;
+#endif
+
+struct ReplayConfig {
+    std::string capture;
+    std::string host = "127.0.0.1";
+    uint16_t port = SERVER_PORT;
+    double speed = 1;
+    std::string output;
+};
+
+void usage() {
+    std::cerr << "usage: replay --capture=file [--host=address] [--port=N] [--speed=X] [--output=file]" << std::endl;
+}
+
+bool parse_args(int argc, char **argv, ReplayConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        auto &&separator = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || separator == std::string::npos) return false;
+        auto &&key = arg.substr(2, separator - 2);
+        auto &&value = arg.substr(separator + 1);
+        if (key == "capture") config.capture = value;
+        else if (key == "host") config.host = value;
+        else if (key == "port") config.port = static_cast<uint16_t>(std::stoul(value));
+        else if (key == "speed") config.speed = std::stod(value);
+        else if (key == "output") config.output = value;
+        else return false;
+    }
+    return !config.capture.empty() && config.speed > 0;
+}
+
+bool is_handshake(std::string_view data) {
+    return !data.empty() && (data[0] == HELLO_MESSAGE || data[0] == COOKIE_MESSAGE);
+}
+
+// The latency of a request runs from the datagram that completes it to the first chunk of
+// the answer. A replay does not wait for answers, so requests of a client can queue up and
+// are matched to answers in order. Handshake packets are left out, the replay makes its own.
+class TrafficStats {
+public:
+    void inbound(int64_t client_id, uint64_t time, std::string_view data) {
+        if (is_handshake(data)) return;
+        count(time);
+        ++datagrams_in;
+        protocol::ChunkHeader header{};
+        std::string_view payload;
+        if (!protocol::parse_packet(data.data(), data.size(), header, payload)) return;
+        if (header.type == CONTENT_MESSAGE && header.number + 1 == header.total) {
+            pending[client_id].push_back(time);
+            ++waiting_requests;
+        }
+    }
+
+    void outbound(int64_t client_id, uint64_t time, std::string_view data) {
+        if (is_handshake(data)) return;
+        count(time);
+        ++datagrams_out;
+        protocol::ChunkHeader header{};
+        std::string_view payload;
+        if (!protocol::parse_packet(data.data(), data.size(), header, payload)) return;
+        if (header.type != CONTENT_MESSAGE || header.number != 0) return;
+        auto &&requests = pending.find(client_id);
+        if (requests == pending.end() || requests->second.empty()) return;
+        latencies.push_back(time - requests->second.front());
+        requests->second.pop_front();
+        --waiting_requests;
+    }
+
+    size_t waiting() const {
+        return waiting_requests;
+    }
+
+    nlohmann::json report() {
+        std::sort(latencies.begin(), latencies.end());
+        auto &&seconds = last > first ? static_cast<double>(last - first) / 1e6 : 0.0;
+        auto &&percentile = [this](double share) -> uint64_t {
+            if (latencies.empty()) return 0;
+            return latencies[static_cast<size_t>(share * static_cast<double>(latencies.size() - 1))];
+        };
+        return {
+                {"datagrams_in",     datagrams_in},
+                {"datagrams_out",    datagrams_out},
+                {"seconds",          seconds},
+                {"datagrams_per_sec", seconds > 0 ? static_cast<double>(datagrams_in + datagrams_out) / seconds : 0.0},
+                {"requests",         latencies.size()},
+                {"requests_per_sec", seconds > 0 ? static_cast<double>(latencies.size()) / seconds : 0.0},
+                {"unanswered",       waiting_requests},
+                {"latency_us_p50",   percentile(0.5)},
+                {"latency_us_p90",   percentile(0.9)},
+                {"latency_us_p99",   percentile(0.99)},
+                {"latency_us_max",   percentile(1.0)},
+        };
+    }
+
+private:
+    void count(uint64_t time) {
+        if (datagrams_in + datagrams_out == 0) first = time;
+        last = time;
+    }
+
+    uint64_t datagrams_in = 0;
+    uint64_t datagrams_out = 0;
+    uint64_t first = 0;
+    uint64_t last = 0;
+    size_t waiting_requests = 0;
+    std::unordered_map<int64_t, std::deque<uint64_t>> pending;
+    std::vector<uint64_t> latencies;
+};
+
+// Every captured client gets its own socket, so the server sees as many sessions as it did.
+class Replay {
+public:
+    Replay(const std::string &host, uint16_t port) : server_address(resolve(host, port)) {}
+
+    ~Replay() {
+        for (auto &&descriptor: descriptors) {
+            close_socket(static_cast<socket_t>(descriptor.fd));
+        }
+    }
+
+    bool connect_client(int64_t client_id) {
+        if (peers.count(client_id) != 0) return true;
+        auto &&socket_d = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (connect(socket_d, reinterpret_cast<const sockaddr *>(&server_address), sizeof(server_address)) != 0) {
+            close_socket(socket_d);
+            return false;
+        }
+        pollfd descriptor{};
+        descriptor.fd = socket_d;
+        descriptor.events = POLLIN;
+        peers[client_id] = descriptors.size();
+        descriptors.push_back(descriptor);
+        client_ids.push_back(client_id);
+        return handshake(peers[client_id]);
+    }
+
+    void send_packet(int64_t client_id, std::string_view data) {
+        auto &&socket_d = static_cast<socket_t>(descriptors[peers[client_id]].fd);
+        send(socket_d, data.data(), static_cast<int>(data.size()), 0);
+    }
+
+    // Waits for answers for up to timeout_ms, a cookie from a server that dropped the session is echoed.
+    template<typename Receive>
+    void receive(int timeout_ms, Receive &&on_packet) {
+        auto &&ready = poll(descriptors.data(), static_cast<unsigned long>(descriptors.size()), timeout_ms);
+        for (size_t i = 0; ready > 0 && i < descriptors.size(); ++i) {
+            if ((descriptors[i].revents & POLLIN) == 0) continue;
+            auto &&socket_d = static_cast<socket_t>(descriptors[i].fd);
+            int bytes;
+            while ((bytes = recv(socket_d, buffer, sizeof(buffer), MSG_DONTWAIT_FLAG)) > 0) {
+                std::string_view data(buffer, static_cast<size_t>(bytes));
+                if (data[0] == COOKIE_MESSAGE) send(socket_d, buffer, bytes, 0);
+                on_packet(client_ids[i], data);
+            }
+        }
+    }
+
+private:
+#ifdef _WIN32
+    static constexpr int MSG_DONTWAIT_FLAG = 0;
+#else
+    static constexpr int MSG_DONTWAIT_FLAG = MSG_DONTWAIT;
+#endif
+
+    static sockaddr_in resolve(const std::string &host, uint16_t port) {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo *result = nullptr;
+        auto &&status = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+        if (status != 0 || result == nullptr) throw std::runtime_error("Cannot resolve " + host);
+        sockaddr_in address{};
+        std::memcpy(&address, result->ai_addr, sizeof(address));
+        freeaddrinfo(result);
+        return address;
+    }
+
+    bool handshake(size_t peer) {
+        auto &&socket_d = static_cast<socket_t>(descriptors[peer].fd);
+        auto &&hello = protocol::hello_packet();
+        for (int attempt = 0; attempt < REPLAY_HANDSHAKE_RETRIES; ++attempt) {
+            send(socket_d, hello.data(), static_cast<int>(hello.size()), 0);
+            auto descriptor = descriptors[peer];
+            if (poll(&descriptor, 1, REPLAY_HANDSHAKE_MS) <= 0) continue;
+            auto &&bytes = recv(socket_d, buffer, sizeof(buffer), 0);
+            if (bytes != static_cast<int>(COOKIE_PACKET_SIZE) || buffer[0] != COOKIE_MESSAGE) continue;
+            send(socket_d, buffer, bytes, 0);
+            return true;
+        }
+        return false;
+    }
+
+    sockaddr_in server_address;
+    std::unordered_map<int64_t, size_t> peers;
+    std::vector<pollfd> descriptors;
+    std::vector<int64_t> client_ids;
+    char buffer[MESSAGE_SIZE];
+};
+
+int main(int argc, char **argv) {
+    ReplayConfig config;
+    if (!parse_args(argc, argv, config)) {
+        usage();
+        return 1;
+    }
+    std::ifstream file(config.capture, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    auto &&capture = contents.str();
+    std::string_view in(capture);
+    if (!file || !protocol::read_capture_header(in)) {
+        std::cerr << "Cannot read capture " << config.capture << std::endl;
+        return 1;
+    }
+    std::vector<protocol::CaptureRecord> records;
+    protocol::CaptureRecord record;
+    while (protocol::read_capture_record(in, record)) {
+        records.push_back(record);
+    }
+    // Captures written before records were stamped under the lock can be slightly out of order.
+    std::stable_sort(records.begin(), records.end(), [](const protocol::CaptureRecord &left,
+                                                        const protocol::CaptureRecord &right) {
+        return left.time < right.time;
+    });
+    if (!in.empty()) std::cerr << "Capture has a truncated tail of " << in.size() << " bytes" << std::endl;
+
+    TrafficStats original;
+    for (auto &&captured: records) {
+        if (captured.direction == CAPTURE_IN) original.inbound(captured.client_id, captured.time, captured.data);
+        else original.outbound(captured.client_id, captured.time, captured.data);
+    }
+
+#ifdef _WIN32
+    WSADATA wsa{};
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return 1;
+#endif
+    TrafficStats replayed;
+    {
+        Replay replay(config.host, config.port);
+        for (auto &&captured: records) {
+            if (captured.direction != CAPTURE_IN || is_handshake(captured.data)) continue;
+            if (!replay.connect_client(captured.client_id)) {
+                std::cerr << "No handshake from " << config.host << ":" << config.port << std::endl;
+                return 1;
+            }
+        }
+        auto &&start = std::chrono::steady_clock::now();
+        auto &&elapsed_us = [&start] {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+        };
+        auto &&on_packet = [&](int64_t client_id, std::string_view data) {
+            replayed.outbound(client_id, elapsed_us(), data);
+        };
+        uint64_t base = records.empty() ? 0 : records.front().time;
+        for (auto &&captured: records) {
+            if (captured.direction != CAPTURE_IN || is_handshake(captured.data)) continue;
+            auto &&target = static_cast<uint64_t>(static_cast<double>(captured.time - base) / config.speed);
+            for (auto now = elapsed_us(); now < target; now = elapsed_us()) {
+                replay.receive(static_cast<int>((target - now) / 1000), on_packet);
+            }
+            replay.send_packet(captured.client_id, captured.data);
+            replayed.inbound(captured.client_id, elapsed_us(), captured.data);
+        }
+        auto &&drain_end = elapsed_us() + REPLAY_DRAIN_MS * 1000;
+        while (replayed.waiting() > 0 && elapsed_us() < drain_end) {
+            replay.receive(10, on_packet);
+        }
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    auto &&original_report = original.report();
+    auto &&replay_report = replayed.report();
+    auto &&ratio = [&](const char *key) {
+        double before = original_report[key];
+        double after = replay_report[key];
+        return before > 0 ? after / before : 0.0;
+    };
+    nlohmann::json report = {
+            {"capture",                config.capture},
+            {"speed",                  config.speed},
+            {"original",               original_report},
+            {"replay",                 replay_report},
+            {"throughput_ratio",       ratio("datagrams_per_sec")},
+            {"latency_p50_ratio",      ratio("latency_us_p50")},
+            {"latency_p99_ratio",      ratio("latency_us_p99")},
+    };
+    if (config.output.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream out(config.output);
+        out << report.dump(2) << std::endl;
+    }
+}
@@ -0,0 +1,58 @@
+#include <stdexcept>
+#include "capture.h"
+#include "logging/logger.h"
+
+server::Capture::Capture(const std::string &path) :
+        file(std::fopen(path.c_str(), "wb")), started(std::chrono::steady_clock::now()), dropped_records(0),
+        terminate(false) {
+    if (file == nullptr) {
+        throw std::runtime_error("Cannot open capture " + path);
+    }
+    protocol::write_capture_header(pending);
+    writer = std::thread(&Capture::write_loop, this);
+    Logger::logger_inst->info("Capturing datagrams to {}", path);
+}
+
+server::Capture::~Capture() {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        terminate = true;
+    }
+    pending_ready.notify_one();
+    writer.join();
+    std::fclose(file);
+    if (dropped_records > 0) {
+        Logger::logger_inst->error("Capture dropped {} datagrams", dropped_records.load());
+    }
+}
+
+// The time is taken under the lock so that records are written in time order.
+void server::Capture::record(uint8_t direction, int64_t client_id, std::string_view data) {
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    auto &&time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count();
+    if (pending.size() > CAPTURE_MAX_PENDING) {
+        ++dropped_records;
+        return;
+    }
+    protocol::write_capture_record(pending, static_cast<uint64_t>(time), client_id, direction, data);
+}
+
+void server::Capture::write_loop() {
+    std::string writing;
+    auto done = false;
+    while (!done) {
+        {
+            std::unique_lock<std::mutex> lock(pending_mutex);
+            pending_ready.wait_for(lock, std::chrono::milliseconds(CAPTURE_FLUSH_MS), [this] { return terminate; });
+            done = terminate;
+            writing.swap(pending);
+        }
+        if (writing.empty()) continue;
+        if (std::fwrite(writing.data(), 1, writing.size(), file) != writing.size()) {
+            Logger::logger_inst->error("Capture write failed");
+        }
+        std::fflush(file);
+        writing.clear();
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef ECHOSERVER_CAPTURE_H
+#define ECHOSERVER_CAPTURE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "protocol/capture.h"
+
+#define CAPTURE_FLUSH_MS 100
+#define CAPTURE_MAX_PENDING (64 * 1024 * 1024)
+
+namespace server {
+
+    // Writes datagrams to a capture file for the replay tool. record() only appends to a
+    // buffer that a background thread swaps out and writes every CAPTURE_FLUSH_MS, and a
+    // record is dropped rather than waited for when CAPTURE_MAX_PENDING bytes are behind.
+    class Capture {
+    public:
+        explicit Capture(const std::string &path);
+
+        ~Capture();
+
+        Capture(const Capture &) = delete;
+
+        Capture &operator=(const Capture &) = delete;
+
+        void record(uint8_t direction, int64_t client_id, std::string_view data);
+
+        uint64_t dropped() const {
+            return dropped_records;
+        }
+
+    private:
+        void write_loop();
+
+        std::FILE *file;
+        std::chrono::steady_clock::time_point started;
+        std::mutex pending_mutex;
+        std::condition_variable pending_ready;
+        std::string pending;
+        std::atomic<uint64_t> dropped_records;
+        bool terminate;
+        std::thread writer;
+    };
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include "ChangeLog.h"
+#include <chrono>
+#include "codec/binary_io.h"
+
+ChangeLog::ChangeLog(std::unique_ptr<FinanceStorage> storage, size_t capacity) :
+        storage(std::move(storage)), capacity(capacity), sequence(0),
+        log_epoch(static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count())) {}
+
+std::mutex &ChangeLog::stripe_for(const std::string &currency) {
+    return stripes[codec::checksum(currency) % stripes.size()];
+}
+
+void ChangeLog::append(uint8_t op, const std::string &currency, const FinanceUnit *unit) {
+    auto &&now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    protocol::Change change{0, op, currency, 0, static_cast<int64_t>(now)};
+    if (unit != nullptr) {
+        change.value = unit->value;
+        change.inc_rel = unit->inc_rel;
+        change.inc_abs = unit->inc_abs;
+        change.date = date_to_timestamp(unit->date);
+    }
+    std::lock_guard<std::mutex> lock(log_mutex);
+    change.sequence = ++sequence;
+    changes.push_back(std::move(change));
+    if (changes.size() > capacity) changes.pop_front();
+}
+
+// Rows inserted directly are not replicated, the same as for db_init.
+int ChangeLog::insert(FinanceUnit &financeUnit) {
+    return storage->insert(financeUnit);
+}
+
+int ChangeLog::add_currency(std::string &currency) {
+    std::lock_guard<std::mutex> lock(stripe_for(currency));
+    auto &&status = storage->add_currency(currency);
+    if (status == 0) append(CHANGE_ADD_CURRENCY, currency);
+    return status;
+}
+
+int ChangeLog::add_currency_value(std::string &currency, double value, FinanceUnit *added) {
+    std::lock_guard<std::mutex> lock(stripe_for(currency));
+    FinanceUnit unit;
+    auto &&status = storage->add_currency_value(currency, value, &unit);
+    if (status == 0) {
+        append(CHANGE_ADD_CURRENCY_VALUE, currency, &unit);
+        if (added != nullptr) *added = std::move(unit);
+    }
+    return status;
+}
+
+int ChangeLog::del_currency(std::string &currency) {
+    std::lock_guard<std::mutex> lock(stripe_for(currency));
+    auto &&status = storage->del_currency(currency);
+    if (status == 0) append(CHANGE_DEL_CURRENCY, currency);
+    return status;
+}
+
+int ChangeLog::currency_history(std::string &currency, std::vector<FinanceUnit> &units) {
+    return storage->currency_history(currency, units);
+}
+
+int ChangeLog::currency_values(std::string &currency, std::vector<FinanceUnit> &units) {
+    return storage->currency_values(currency, units);
+}
+
+int ChangeLog::currency_list(std::vector<FinanceUnit> &units) {
+    return storage->currency_list(units);
+}
+
+int ChangeLog::maintain(int64_t now) {
+    return storage->maintain(now);
+}
+
+void ChangeLog::set_retention(const RetentionPolicy &policy) {
+    storage->set_retention(policy);
+}
+
+int ChangeLog::export_units(const std::vector<std::string> &currencies, const ExportSink &sink) {
+    return storage->export_units(currencies, sink);
+}
+
+void ChangeLog::changes_since(uint64_t since, size_t limit, protocol::ChangeBatch &batch) {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    batch.epoch = log_epoch;
+    batch.head = sequence;
+    batch.changes.clear();
+    auto &&first = sequence - changes.size() + 1;
+    batch.truncated = since + 1 < first;
+    if (batch.truncated || since >= sequence) return;
+    auto &&offset = since + 1 - first;
+    for (auto i = offset; i < changes.size() && batch.changes.size() < limit; ++i) {
+        batch.changes.push_back(changes[i]);
+    }
+}
+
+int ChangeLog::snapshot(std::string &currency, std::vector<FinanceUnit> &units, uint64_t &snapshot_sequence) {
+    std::lock_guard<std::mutex> lock(stripe_for(currency));
+    snapshot_sequence = head();
+    return storage->currency_values(currency, units);
+}
+
+uint64_t ChangeLog::head() {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    return sequence;
+}
+
+uint64_t ChangeLog::epoch() const {
+    return log_epoch;
+}
@@ -0,0 +1,72 @@
+#ifndef ECHOSERVER_CHANGE_LOG_H
+#define ECHOSERVER_CHANGE_LOG_H
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "FinanceStorage.h"
+#include "protocol/changes.h"
+
+#define CHANGE_LOG_CAPACITY 262144
+#define CHANGE_BATCH_LIMIT 512
+#define CHANGE_LOG_STRIPES 64
+
+// Wraps a storage engine and numbers every successful add_currency, add_currency_value
+// and del_currency. A write holds the lock of its currency stripe while it is applied and
+// logged, so the changes of one currency are logged in the order the engine applied them
+// and snapshot() sees exactly the changes up to the sequence it returns. Only the last
+// CHANGE_LOG_CAPACITY changes are kept in memory; a replica that falls further behind
+// has to copy the data again.
+class ChangeLog : public FinanceStorage {
+public:
+    explicit ChangeLog(std::unique_ptr<FinanceStorage> storage, size_t capacity = CHANGE_LOG_CAPACITY);
+
+    int insert(FinanceUnit &financeUnit) override;
+
+    int add_currency(std::string &currency) override;
+
+    int add_currency_value(std::string &currency, double value, FinanceUnit *added = nullptr) override;
+
+    int del_currency(std::string &currency) override;
+
+    int currency_history(std::string &currency, std::vector<FinanceUnit> &units) override;
+
+    int currency_values(std::string &currency, std::vector<FinanceUnit> &units) override;
+
+    int currency_list(std::vector<FinanceUnit> &units) override;
+
+    int maintain(int64_t now) override;
+
+    void set_retention(const RetentionPolicy &policy) override;
+
+    int export_units(const std::vector<std::string> &currencies, const ExportSink &sink) override;
+
+    // Fills batch with at most limit changes after since; batch.truncated is set when
+    // some of them are no longer kept.
+    void changes_since(uint64_t since, size_t limit, protocol::ChangeBatch &batch);
+
+    // Values of one currency together with the sequence of the last change they include.
+    int snapshot(std::string &currency, std::vector<FinanceUnit> &units, uint64_t &sequence);
+
+    uint64_t head();
+
+    uint64_t epoch() const;
+
+private:
+    std::mutex &stripe_for(const std::string &currency);
+
+    void append(uint8_t op, const std::string &currency, const FinanceUnit *unit = nullptr);
+
+    std::unique_ptr<FinanceStorage> storage;
+    std::array<std::mutex, CHANGE_LOG_STRIPES> stripes;
+    std::mutex log_mutex;
+    std::deque<protocol::Change> changes;
+    size_t capacity;
+    uint64_t sequence;
+    uint64_t log_epoch;
+};
+
+
+#endif
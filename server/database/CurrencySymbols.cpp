@@ -0,0 +1,34 @@
+#include "CurrencySymbols.h"
+#include <mutex>
+
+int64_t CurrencySymbols::find(const std::string &code) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto &&found = ids.find(code);
+    return found == ids.end() ? NO_CURRENCY_ID : found->second;
+}
+
+const std::string &CurrencySymbols::code(int64_t id) const {
+    static const std::string unknown;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if (id <= 0 || static_cast<size_t>(id) > codes.size()) return unknown;
+    return codes[id - 1];
+}
+
+// A code is written once, for an id that has none yet, so a reference returned by code()
+// is never written to while it is read. Known ids only take the shared lock.
+void CurrencySymbols::add(int64_t id, const std::string &code) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (static_cast<size_t>(id) <= codes.size() && !codes[id - 1].empty()) return;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (static_cast<size_t>(id) > codes.size()) codes.resize(id);
+    if (!codes[id - 1].empty()) return;
+    codes[id - 1] = code;
+    ids[code] = id;
+}
+
+int64_t CurrencySymbols::max_id() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return static_cast<int64_t>(codes.size());
+}
@@ -0,0 +1,35 @@
+#ifndef ECHOSERVER_CURRENCY_SYMBOLS_H
+#define ECHOSERVER_CURRENCY_SYMBOLS_H
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#define NO_CURRENCY_ID 0
+
+// Maps currency codes to the small integer ids that rows and caches are keyed by. Ids
+// come from the currencies table, start at 1 and are never reused, so they can index
+// dense arrays. Codes are never removed, a deleted currency keeps its id for when it is
+// added again. Lookups take a shared lock; a returned code stays valid and unchanged for
+// the lifetime of the table, since the codes live in a deque and each is written only once.
+class CurrencySymbols {
+public:
+    // NO_CURRENCY_ID when the code is unknown.
+    int64_t find(const std::string &code) const;
+
+    const std::string &code(int64_t id) const;
+
+    void add(int64_t id, const std::string &code);
+
+    int64_t max_id() const;
+
+private:
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, int64_t> ids;
+    std::deque<std::string> codes;
+};
+
+
+#endif
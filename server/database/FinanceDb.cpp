@@ -1,49 +1,167 @@
 #include "FinanceDb.h"
+#include <algorithm>
+#include <chrono>
+#include "MappedFile.h"
+#include "TickBlock.h"
+#include "codec/binary_io.h"
 #include "logging/logger.h"
 
-std::tm parse_date(const std::string &date_str) {
-    std::tm datetime = {};
-    std::istringstream ss(date_str);
-    ss >> std::get_time(&datetime, "%Y-%b-%d %H:%M:%S");
-    return datetime;
+#define FINANCE_COLUMNS_SQL " (id INTEGER PRIMARY KEY, currency_id INTEGER, value REAL, inc_rel REAL, inc_abs REAL, date TEXT)"
+#define CURRENCIES_TABLE_SQL "CREATE TABLE IF NOT EXISTS currencies (id INTEGER PRIMARY KEY, code TEXT NOT NULL UNIQUE)"
+#define FINANCE_BLOCKS_COLUMNS_SQL " (id INTEGER PRIMARY KEY, currency_id INTEGER, start_time INTEGER, end_time INTEGER," \
+        " count INTEGER, data BLOB, resolution INTEGER NOT NULL DEFAULT 0)"
+
+namespace {
+    bool has_column(SQLite::Database &db, const std::string &table, const std::string &column) {
+        SQLite::Statement query(db, "SELECT COUNT(*) FROM pragma_table_info(?) WHERE name = ?");
+        query.bind(1, table);
+        query.bind(2, column);
+        return query.executeStep() && query.getColumn(0).getInt() > 0;
+    }
+}
+
+FinanceDb::FinanceDb(const std::string &path) :
+        path(path), db_ptr(new SQLite::Database(path, SQLite::OPEN_READWRITE)), db_mutex(),
+        read_ptr(nullptr), read_mutex(), quotes_row_id(0), generation(0) {
+    db_ptr->exec("PRAGMA journal_mode = WAL");
+    upgrade_schema(*db_ptr);
+    read_ptr = new SQLite::Database(path, SQLite::OPEN_READONLY);
+    load_symbols();
+    load_quotes();
 }
 
-void FinanceDb::reset() {
+FinanceDb::~FinanceDb() {
+    save_quotes();
+    delete read_ptr;
+    delete db_ptr;
+}
+
+void FinanceDb::reset(const std::string &path) {
     try {
         Logger::logger_inst->info("Resetting database");
-        SQLite::Database db("finance.db", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+        SQLite::Database db(path, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
         db.exec("DROP TABLE IF EXISTS finance");
+        db.exec("DROP TABLE IF EXISTS finance_blocks");
+        db.exec("DROP TABLE IF EXISTS finance_state");
+        db.exec("DROP TABLE IF EXISTS currencies");
+        db.exec("PRAGMA auto_vacuum = INCREMENTAL");
+        db.exec("VACUUM");
+        std::remove((path + QUOTES_SUFFIX).c_str());
         SQLite::Transaction transaction(db);
-        db.exec("CREATE TABLE finance ("
-                        " id INTEGER PRIMARY KEY,"
-                        " currency TEXT,"
-                        " value REAL,"
-                        " inc_rel REAL,"
-                        " inc_abs REAL,"
-                        " date TEXT"
-                        ")");
+        db.exec("CREATE TABLE finance" FINANCE_COLUMNS_SQL);
+        create_aux_tables(db);
         transaction.commit();
     } catch (std::exception &ex) {
         Logger::logger_inst->error("DB exception: {}", ex.what());
     }
 }
 
+void FinanceDb::create_aux_tables(SQLite::Database &db) {
+    db.exec(CURRENCIES_TABLE_SQL);
+    db.exec(FINANCE_CURRENCY_INDEX_SQL);
+    db.exec("CREATE TABLE IF NOT EXISTS finance_blocks" FINANCE_BLOCKS_COLUMNS_SQL);
+    if (!has_column(db, "finance_blocks", "resolution")) {
+        db.exec("ALTER TABLE finance_blocks ADD COLUMN resolution INTEGER NOT NULL DEFAULT 0");
+    }
+    db.exec("CREATE INDEX IF NOT EXISTS finance_blocks_currency ON finance_blocks (currency_id, start_time)");
+    db.exec("CREATE INDEX IF NOT EXISTS finance_blocks_age ON finance_blocks (resolution, end_time)");
+    db.exec("CREATE TABLE IF NOT EXISTS finance_state (id INTEGER PRIMARY KEY, generation INTEGER)");
+    db.exec("INSERT OR IGNORE INTO finance_state VALUES (0, 0)");
+}
+
+// Row ids are kept, the saved quotes are dropped by the version change of their file. A
+// database created without incremental auto vacuum is rebuilt once to get it.
+void FinanceDb::upgrade_schema(SQLite::Database &db) {
+    SQLite::Statement vacuum_mode(db, "PRAGMA auto_vacuum");
+    auto &&incremental_vacuum = vacuum_mode.executeStep() && vacuum_mode.getColumn(0).getInt() == 2;
+    vacuum_mode.reset();
+    if (!incremental_vacuum) {
+        Logger::logger_inst->info("Enabling incremental vacuum");
+        db.exec("PRAGMA auto_vacuum = INCREMENTAL");
+    }
+    if (!has_column(db, "finance", "currency")) {
+        create_aux_tables(db);
+        if (!incremental_vacuum) db.exec("VACUUM");
+        return;
+    }
+    Logger::logger_inst->info("Moving currency codes to the currencies table");
+    auto &&had_blocks = has_column(db, "finance_blocks", "currency");
+    {
+        SQLite::Transaction transaction(db);
+        db.exec(CURRENCIES_TABLE_SQL);
+        db.exec("INSERT OR IGNORE INTO currencies (code)"
+                " SELECT currency FROM finance WHERE currency IS NOT NULL GROUP BY currency ORDER BY MIN(id)");
+        db.exec("CREATE TABLE finance_by_id" FINANCE_COLUMNS_SQL);
+        db.exec("INSERT INTO finance_by_id SELECT finance.id, currencies.id, value, inc_rel, inc_abs, date"
+                " FROM finance JOIN currencies ON currencies.code = finance.currency");
+        db.exec("DROP TABLE finance");
+        db.exec("ALTER TABLE finance_by_id RENAME TO finance");
+        if (had_blocks) {
+            db.exec("INSERT OR IGNORE INTO currencies (code) SELECT DISTINCT currency FROM finance_blocks");
+            db.exec("CREATE TABLE finance_blocks_by_id" FINANCE_BLOCKS_COLUMNS_SQL);
+            db.exec("INSERT INTO finance_blocks_by_id (id, currency_id, start_time, end_time, count, data)"
+                    " SELECT finance_blocks.id, currencies.id, start_time, end_time,"
+                    " count, data FROM finance_blocks JOIN currencies ON currencies.code = finance_blocks.currency");
+            db.exec("DROP TABLE finance_blocks");
+            db.exec("ALTER TABLE finance_blocks_by_id RENAME TO finance_blocks");
+        }
+        create_aux_tables(db);
+        db.exec("UPDATE finance_state SET generation = generation + 1 WHERE id = 0");
+        transaction.commit();
+    }
+    db.exec("VACUUM");
+}
+
+void FinanceDb::load_symbols() {
+    SQLite::Statement query(*db_ptr, "SELECT id, code FROM currencies");
+    while (query.executeStep()) {
+        symbols.add(query.getColumn(0).getInt64(), query.getColumn(1).getString());
+    }
+}
+
+// Has to be called with db_mutex held and inside a transaction; the caller adds the code to
+// symbols once the transaction is committed.
+int64_t FinanceDb::intern(const std::string &currency) {
+    auto &&known = symbols.find(currency);
+    if (known != NO_CURRENCY_ID) return known;
+    SQLite::Statement query(*db_ptr, "INSERT INTO currencies (code) VALUES (?)");
+    query.bind(1, currency);
+    query.exec();
+    return db_ptr->getLastInsertRowid();
+}
+
+LatestQuote *FinanceDb::find_quote(const std::string &currency) {
+    auto &&currency_id = symbols.find(currency);
+    if (currency_id == NO_CURRENCY_ID || static_cast<size_t>(currency_id) >= quotes.size()) return nullptr;
+    auto &&quote = quotes[currency_id];
+    return quote.id == 0 ? nullptr : &quote;
+}
+
+// A currency that only has its placeholder row loses it to the first row inserted, the same
+// as with add_currency_value.
 int FinanceDb::insert(FinanceUnit &financeUnit) {
-    std::stringstream sql_builder;
-    sql_builder << "INSERT INTO finance VALUES ("
-                << "NULL" << ","
-                << "\"" << financeUnit.currency << "\","
-                << financeUnit.value << ","
-                << financeUnit.inc_rel << ","
-                << financeUnit.inc_abs << ","
-                << "\"" << std::put_time(&financeUnit.date, "%Y-%b-%d %H:%M:%S") << "\""
-                << ")";
-    auto &&sql = sql_builder.str();
     try {
         std::unique_lock<std::mutex> lock(db_mutex);
+        auto &&found = find_quote(financeUnit.currency);
+        auto &&placeholder = found != nullptr && !found->has_value ? found->id : 0;
         SQLite::Transaction transaction(*db_ptr);
-        db_ptr->exec(sql);
+        auto &&currency_id = intern(financeUnit.currency);
+        SQLite::Statement query(*db_ptr, "INSERT INTO finance VALUES (NULL, ?, ?, ?, ?, ?)");
+        query.bind(1, currency_id);
+        query.bind(2, financeUnit.value);
+        query.bind(3, financeUnit.inc_rel);
+        query.bind(4, financeUnit.inc_abs);
+        query.bind(5, format_date(financeUnit.date));
+        query.exec();
+        auto &&id = db_ptr->getLastInsertRowid();
+        if (placeholder != 0) {
+            SQLite::Statement remove_placeholder(*db_ptr, "DELETE FROM finance WHERE id = ?");
+            remove_placeholder.bind(1, placeholder);
+            remove_placeholder.exec();
+        }
         transaction.commit();
+        symbols.add(currency_id, financeUnit.currency);
+        update_quote(currency_id, id, financeUnit.value, true);
         lock.unlock();
     } catch (std::exception &ex) {
         Logger::logger_inst->error("DB insert exception: {}", ex.what());
@@ -54,28 +172,19 @@ int FinanceDb::insert(FinanceUnit &financeUnit) {
 
 int FinanceDb::add_currency(std::string &currency) {
     try {
-        SQLite::Statement query(*db_ptr, "SELECT count(*) FROM finance WHERE currency = ?");
-        query.bind(1, currency);
-        query.executeStep();
-        int count = query.getColumn(0);
-        if (count != 0) return 1;
         auto &&_time = time(nullptr);
-        auto &&timev = std::localtime(&_time);
-        std::stringstream sql_builder;
-        sql_builder << "INSERT INTO finance VALUES ("
-                    << "NULL" << ","
-                    << "\"" << currency << "\","
-                    << "NULL" << ","
-                    << "NULL" << ","
-                    << "NULL" << ","
-                    << "\"" << std::put_time(timev, "%Y-%b-%d %H:%M:%S") << "\""
-                    << ")";
-        auto &&sql = sql_builder.str();
-        Logger::logger_inst->info(sql);
         std::unique_lock<std::mutex> lock(db_mutex);
+        if (find_quote(currency) != nullptr) return 1;
         SQLite::Transaction transaction(*db_ptr);
-        db_ptr->exec(sql);
+        auto &&currency_id = intern(currency);
+        SQLite::Statement query(*db_ptr, "INSERT INTO finance VALUES (NULL, ?, NULL, NULL, NULL, ?)");
+        query.bind(1, currency_id);
+        query.bind(2, format_date(timestamp_to_date(_time)));
+        LOG_TRACE(query.getQuery());
+        query.exec();
         transaction.commit();
+        symbols.add(currency_id, currency);
+        update_quote(currency_id, db_ptr->getLastInsertRowid(), 0, false);
         lock.unlock();
 
     } catch (std::exception &ex) {
@@ -85,54 +194,39 @@ int FinanceDb::add_currency(std::string &currency) {
     return 0;
 }
 
-int FinanceDb::add_currency_value(std::string &currency, double value) {
+// The first value of a currency replaces its placeholder row. The new row is inserted
+// before the placeholder is removed so that its id is never reused.
+int FinanceDb::add_currency_value(std::string &currency, double value, FinanceUnit *added) {
     try {
-        SQLite::Statement query(*db_ptr, "SELECT id, value, "
-                "CASE WHEN value IS NULL THEN 1 ELSE 0 END"
-                " FROM finance WHERE currency = ? ORDER BY date DESC");
-        query.bind(1, currency);
-        Logger::logger_inst->info(query.getQuery());
-        auto &&status = query.executeStep();
-        if (!status) return 1;
-        int id = query.getColumn(0);
-        double cur_value = query.getColumn(1);
-        int is_new = query.getColumn(2);
-        double relative = 0, absolute = 0;
-        if (!is_new) {
-            absolute = value - cur_value;
-            relative = absolute / cur_value;
-        }
-        auto &&_time = time(nullptr);
-        auto &&timev = std::localtime(&_time);
-        std::stringstream sql_builder;
-        sql_builder << "(";
-        if (!is_new) {
-            sql_builder << "NULL,"
-                        << "\"" << currency << "\",";
-        }
-        sql_builder << value << ","
-                    << relative << ","
-                    << absolute << ","
-                    << "\"" << std::put_time(timev, "%Y-%b-%d %H:%M:%S") << "\""
-                    << ")";
-        auto &&sql_value = sql_builder.str();
-        sql_builder.str("");
-        if (is_new) {
-            sql_builder << "UPDATE finance SET"
-                        << "(value, inc_rel, inc_abs, date) = "
-                        << sql_value
-                        << "WHERE id = "
-                        << id;
-        } else {
-            sql_builder << "INSERT INTO finance VALUES" << sql_value;
-        }
-        auto &&sql = sql_builder.str();
-        Logger::logger_inst->info(sql);
         std::unique_lock<std::mutex> lock(db_mutex);
+        auto &&found = find_quote(currency);
+        if (found == nullptr) return 1;
+        auto latest = *found;
+        auto &&currency_id = symbols.find(currency);
+        FinanceUnit unit{currency, value, 0, 0, timestamp_to_date(time(nullptr))};
+        if (latest.has_value) {
+            unit.inc_abs = value - latest.value;
+            unit.inc_rel = unit.inc_abs / latest.value;
+        }
+        SQLite::Statement query(*db_ptr, "INSERT INTO finance VALUES (NULL, ?, ?, ?, ?, ?)");
+        query.bind(1, currency_id);
+        query.bind(2, unit.value);
+        query.bind(3, unit.inc_rel);
+        query.bind(4, unit.inc_abs);
+        query.bind(5, format_date(unit.date));
+        LOG_TRACE(query.getQuery());
         SQLite::Transaction transaction(*db_ptr);
-        db_ptr->exec(sql);
+        query.exec();
+        auto &&id = db_ptr->getLastInsertRowid();
+        if (!latest.has_value) {
+            SQLite::Statement remove_placeholder(*db_ptr, "DELETE FROM finance WHERE id = ?");
+            remove_placeholder.bind(1, static_cast<int64_t>(latest.id));
+            remove_placeholder.exec();
+        }
         transaction.commit();
+        update_quote(currency_id, id, value, true);
         lock.unlock();
+        if (added != nullptr) *added = std::move(unit);
     } catch (std::exception &ex) {
         Logger::logger_inst->error("DB select exception: {}", ex.what());
         return -1;
@@ -143,14 +237,22 @@ int FinanceDb::add_currency_value(std::string &currency, double value) {
 int FinanceDb::del_currency(std::string &currency) {
     try {
         std::unique_lock<std::mutex> lock(db_mutex);
-        SQLite::Statement query(*db_ptr, "DELETE FROM finance WHERE currency = ?");
-        query.bind(1, currency);
-        Logger::logger_inst->info(query.getQuery());
+        auto &&currency_id = symbols.find(currency);
+        if (currency_id == NO_CURRENCY_ID) return 1;
+        SQLite::Statement query(*db_ptr, "DELETE FROM finance WHERE currency_id = ?");
+        query.bind(1, currency_id);
+        LOG_TRACE(query.getQuery());
+        SQLite::Statement blocks_query(*db_ptr, "DELETE FROM finance_blocks WHERE currency_id = ?");
+        blocks_query.bind(1, currency_id);
         SQLite::Transaction transaction(*db_ptr);
         auto &&count = query.exec();
+        if (count == 0) return 1;
+        blocks_query.exec();
+        db_ptr->exec("UPDATE finance_state SET generation = generation + 1 WHERE id = 0");
         transaction.commit();
+        if (static_cast<size_t>(currency_id) < quotes.size()) quotes[currency_id] = LatestQuote{0, 0, false};
+        ++generation;
         lock.unlock();
-        if (count == 0) return 1;
     }
     catch (std::exception &ex) {
         Logger::logger_inst->error("DB select exception: {}", ex.what());
@@ -159,24 +261,24 @@ int FinanceDb::del_currency(std::string &currency) {
     return 0;
 }
 
-int FinanceDb::currency_list(nlohmann::json &json) {
+// Blocks and rows are read in one read transaction, so rows sealed in between are seen once.
+int FinanceDb::currency_list(std::vector<FinanceUnit> &units) {
     try {
-        SQLite::Statement query(*db_ptr, "SELECT currency, value, inc_rel, inc_abs, date FROM finance");
-        Logger::logger_inst->info(query.getQuery());
+        std::lock_guard<std::mutex> lock(read_mutex);
+        SQLite::Transaction snapshot(*read_ptr);
+        SQLite::Statement blocks_query(*read_ptr, "SELECT currency_id, count, data FROM finance_blocks"
+                " ORDER BY currency_id, start_time, id");
+        read_blocks(blocks_query, units);
+        SQLite::Statement query(*read_ptr, "SELECT currency_id, value, inc_rel, inc_abs, date FROM finance ORDER BY id");
+        LOG_TRACE(query.getQuery());
         while (query.executeStep()) {
-            std::string currency = query.getColumn(0);
-            double value = query.getColumn(1);
-            double inc_rel = query.getColumn(2);
-            double inc_abs = query.getColumn(3);
-            std::string date = query.getColumn(4);
-            nlohmann::json item = {
-                    {"currency",          currency},
-                    {"value",             value},
-                    {"relative_increase", inc_rel},
-                    {"absolute_increase", inc_abs},
-                    {"date",              date},
-            };
-            json.push_back(item);
+            FinanceUnit unit;
+            unit.currency = symbols.code(query.getColumn(0).getInt64());
+            unit.value = query.getColumn(1);
+            unit.inc_rel = query.getColumn(2);
+            unit.inc_abs = query.getColumn(3);
+            unit.date = parse_date(query.getColumn(4));
+            units.emplace_back(std::move(unit));
         }
     }
     catch (std::exception &ex) {
@@ -186,24 +288,44 @@ int FinanceDb::currency_list(nlohmann::json &json) {
     return 0;
 }
 
-int FinanceDb::currency_history(std::string &curr, nlohmann::json &json) {
+int FinanceDb::currency_history(std::string &curr, std::vector<FinanceUnit> &units) {
+    return read_history(curr, units, true);
+}
+
+int FinanceDb::currency_values(std::string &curr, std::vector<FinanceUnit> &units) {
+    return read_history(curr, units, false);
+}
+
+// The placeholder row of a currency without values has NULL columns and reads as zeros.
+int FinanceDb::read_history(std::string &curr, std::vector<FinanceUnit> &units, bool with_placeholder) {
     try {
-        SQLite::Statement query(*db_ptr, "SELECT value, date FROM finance WHERE currency = ?");
-        query.bind(1, curr);
-        Logger::logger_inst->info(query.getQuery());
-        nlohmann::json result;
+        auto &&currency_id = symbols.find(curr);
+        if (currency_id == NO_CURRENCY_ID) return 1;
+        std::lock_guard<std::mutex> read_lock(read_mutex);
+        SQLite::Transaction snapshot(*read_ptr);
+        SQLite::Statement blocks_query(*read_ptr, "SELECT currency_id, count, data FROM finance_blocks"
+                " WHERE currency_id = ? ORDER BY start_time, id");
+        blocks_query.bind(1, currency_id);
+        read_blocks(blocks_query, units);
+        SQLite::Statement query(*read_ptr, with_placeholder
+                ? "SELECT value, inc_rel, inc_abs, date FROM finance WHERE currency_id = ? ORDER BY id"
+                : "SELECT value, inc_rel, inc_abs, date FROM finance WHERE currency_id = ? AND value IS NOT NULL"
+                  " ORDER BY id");
+        query.bind(1, currency_id);
+        LOG_TRACE(query.getQuery());
         while (query.executeStep()) {
-            double value = query.getColumn(0);
-            std::string date = query.getColumn(1);
-            nlohmann::json item = {
-                    {"value", value},
-                    {"date",  date},
-            };
-            result.push_back(item);
-        }
-        if (result.empty()) return 1;
-        json["currency"] = curr;
-        json["history"] = result;
+            FinanceUnit unit;
+            unit.currency = curr;
+            unit.value = query.getColumn(0);
+            unit.inc_rel = query.getColumn(1);
+            unit.inc_abs = query.getColumn(2);
+            unit.date = parse_date(query.getColumn(3));
+            units.emplace_back(std::move(unit));
+        }
+        if (units.empty()) {
+            std::lock_guard<std::mutex> lock(db_mutex);
+            if (with_placeholder || find_quote(curr) == nullptr) return 1;
+        }
     }
     catch (std::exception &ex) {
         Logger::logger_inst->error("DB select exception: {}", ex.what());
@@ -212,5 +334,401 @@ int FinanceDb::currency_history(std::string &curr, nlohmann::json &json) {
     return 0;
 }
 
+void FinanceDb::read_blocks(SQLite::Statement &query, std::vector<FinanceUnit> &units) {
+    LOG_TRACE(query.getQuery());
+    while (query.executeStep()) {
+        auto &&currency = symbols.code(query.getColumn(0).getInt64());
+        auto &&count = static_cast<uint32_t>(query.getColumn(1).getInt());
+        auto &&data = query.getColumn(2);
+        TickBlockReader reader(std::string_view(static_cast<const char *>(data.getBlob()), data.getBytes()), count);
+        codec::Tick tick{};
+        while (reader.next(tick)) {
+            units.push_back(FinanceUnit{currency, tick.value, tick.inc_rel, tick.inc_abs,
+                                        timestamp_to_date(tick.timestamp)});
+        }
+    }
+}
+
+int FinanceDb::maintain(int64_t now) {
+    auto &&sealed = seal_blocks(BLOCK_WINDOW_SECONDS, now);
+    auto &&compacted = compact(now);
+    save_quotes();
+    return compacted < 0 ? -1 : sealed;
+}
+
+// Blocks and rows are read in one read transaction on a separate connection.
+int FinanceDb::export_units(const std::vector<std::string> &currencies, const ExportSink &sink) {
+    try {
+        SQLite::Database snapshot_db(path, SQLite::OPEN_READONLY);
+        SQLite::Transaction snapshot(snapshot_db);
+        auto names = currencies;
+        if (names.empty()) {
+            SQLite::Statement names_query(snapshot_db, "SELECT code FROM currencies WHERE id IN"
+                    " (SELECT currency_id FROM finance WHERE value IS NOT NULL"
+                    " UNION SELECT currency_id FROM finance_blocks) ORDER BY code");
+            while (names_query.executeStep()) {
+                names.push_back(names_query.getColumn(0).getString());
+            }
+        }
+        SQLite::Statement blocks_query(snapshot_db, "SELECT count, data FROM finance_blocks"
+                " WHERE currency_id = (SELECT id FROM currencies WHERE code = ?) ORDER BY start_time, id");
+        SQLite::Statement rows_query(snapshot_db, "SELECT value, inc_rel, inc_abs, date FROM finance"
+                " WHERE currency_id = (SELECT id FROM currencies WHERE code = ?) AND value IS NOT NULL ORDER BY id");
+        std::vector<FinanceUnit> batch;
+        batch.reserve(EXPORT_BATCH_ROWS);
+        auto &&flush = [&](bool force) {
+            if (batch.empty() || (!force && batch.size() < EXPORT_BATCH_ROWS)) return true;
+            if (!sink(batch)) return false;
+            batch.clear();
+            return true;
+        };
+        for (auto &&currency: names) {
+            blocks_query.bind(1, currency);
+            while (blocks_query.executeStep()) {
+                auto &&count = static_cast<uint32_t>(blocks_query.getColumn(0).getInt());
+                auto &&data = blocks_query.getColumn(1);
+                TickBlockReader reader(std::string_view(static_cast<const char *>(data.getBlob()), data.getBytes()),
+                                       count);
+                codec::Tick tick{};
+                while (reader.next(tick)) {
+                    batch.push_back(FinanceUnit{currency, tick.value, tick.inc_rel, tick.inc_abs,
+                                                timestamp_to_date(tick.timestamp)});
+                }
+                if (!flush(false)) return -1;
+            }
+            blocks_query.reset();
+            rows_query.bind(1, currency);
+            while (rows_query.executeStep()) {
+                batch.push_back(FinanceUnit{currency, rows_query.getColumn(0), rows_query.getColumn(1),
+                                            rows_query.getColumn(2), parse_date(rows_query.getColumn(3))});
+                if (!flush(false)) return -1;
+            }
+            rows_query.reset();
+        }
+        if (!flush(true)) return -1;
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("DB export exception: {}", ex.what());
+        return -1;
+    }
+    return 0;
+}
+
+int FinanceDb::seal_blocks(int64_t window_seconds, int64_t now) {
+    auto &&boundary = now - now % window_seconds;
+    int sealed = 0;
+    try {
+        std::vector<int64_t> currency_ids;
+        {
+            std::lock_guard<std::mutex> lock(db_mutex);
+            SQLite::Statement query(*db_ptr, "SELECT DISTINCT currency_id FROM finance");
+            while (query.executeStep()) {
+                currency_ids.push_back(query.getColumn(0).getInt64());
+            }
+        }
+        for (auto &&currency_id: currency_ids) {
+            sealed += seal_currency(currency_id, window_seconds, boundary);
+        }
+    }
+    catch (std::exception &ex) {
+        Logger::logger_inst->error("DB seal exception: {}", ex.what());
+        return -1;
+    }
+    if (sealed > 0) Logger::logger_inst->info("Sealed {} ticks into blocks", sealed);
+    return sealed;
+}
+
+int FinanceDb::seal_currency(int64_t currency_id, int64_t window_seconds, int64_t boundary) {
+    int sealed = 0;
+    int64_t after = 0;
+    while (true) {
+        auto &&batch = seal_batch(currency_id, window_seconds, boundary, after);
+        if (batch == 0) break;
+        sealed += batch;
+    }
+    return sealed;
+}
+
+// Seals at most SEAL_BATCH_WINDOWS windows out of at most SEAL_BATCH_ROWS rows after the row
+// id after, so writes to other currencies wait for one batch and not for the whole backlog.
+// Dates are stored as local text that does not sort, so rows are read in id order and reading
+// stops at the first one dated at or after the boundary. The latest row stays in the table
+// for the quote cache.
+int FinanceDb::seal_batch(int64_t currency_id, int64_t window_seconds, int64_t boundary, int64_t &after) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (static_cast<size_t>(currency_id) >= quotes.size()) return 0;
+    std::vector<int64_t> ids;
+    std::vector<codec::Tick> ticks;
+    std::vector<size_t> windows;
+    SQLite::Statement query(*db_ptr, "SELECT id, value, inc_rel, inc_abs, date FROM finance"
+            " WHERE currency_id = ? AND value IS NOT NULL AND id > ? AND id < ? ORDER BY id LIMIT ?");
+    query.bind(1, currency_id);
+    query.bind(2, after);
+    query.bind(3, static_cast<int64_t>(quotes[currency_id].id));
+    query.bind(4, SEAL_BATCH_ROWS);
+    auto complete = false;
+    while (query.executeStep()) {
+        codec::Tick tick{date_to_timestamp(parse_date(query.getColumn(4))),
+                         query.getColumn(1), query.getColumn(2), query.getColumn(3)};
+        if (tick.timestamp >= boundary) {
+            complete = true;
+            break;
+        }
+        if (ticks.empty() || tick.timestamp / window_seconds != ticks.back().timestamp / window_seconds) {
+            if (windows.size() == SEAL_BATCH_WINDOWS) {
+                complete = true;
+                break;
+            }
+            windows.push_back(ticks.size());
+        }
+        ids.push_back(query.getColumn(0).getInt64());
+        ticks.push_back(tick);
+    }
+    if (ticks.size() < SEAL_BATCH_ROWS) complete = true;
+    // The last window of a full batch may go on in the next one, unless it fills the batch.
+    if (!complete && windows.size() > 1) {
+        ids.resize(windows.back());
+        ticks.resize(windows.back());
+        windows.pop_back();
+    }
+    if (ticks.empty()) return 0;
+
+    SQLite::Statement insert_block(*db_ptr, "INSERT INTO finance_blocks (currency_id, start_time, end_time, count, data)"
+            " VALUES (?, ?, ?, ?, ?)");
+    SQLite::Statement remove_rows(*db_ptr, "DELETE FROM finance"
+            " WHERE currency_id = ? AND value IS NOT NULL AND id BETWEEN ? AND ?");
+    SQLite::Transaction transaction(*db_ptr);
+    for (size_t window = 0; window < windows.size(); ++window) {
+        auto &&begin = windows[window];
+        auto &&end = window + 1 < windows.size() ? windows[window + 1] : ticks.size();
+        std::string data;
+        TickBlockWriter writer(data);
+        for (auto i = begin; i < end; ++i) {
+            writer.add(ticks[i]);
+        }
+        writer.finish();
+        insert_block.bind(1, currency_id);
+        insert_block.bind(2, static_cast<int64_t>(ticks[begin].timestamp));
+        insert_block.bind(3, static_cast<int64_t>(ticks[end - 1].timestamp));
+        insert_block.bind(4, static_cast<int>(writer.size()));
+        insert_block.bind(5, data.data(), static_cast<int>(data.size()));
+        insert_block.exec();
+        insert_block.reset();
+        remove_rows.bind(1, currency_id);
+        remove_rows.bind(2, static_cast<int64_t>(ids[begin]));
+        remove_rows.bind(3, static_cast<int64_t>(ids[end - 1]));
+        remove_rows.exec();
+        remove_rows.reset();
+    }
+    transaction.commit();
+    after = ids.back();
+    return static_cast<int>(ticks.size());
+}
+
+void FinanceDb::set_retention(const RetentionPolicy &policy) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    retention = policy;
+}
+
+// The oldest tier is applied first, so blocks past it are rewritten once at its resolution
+// rather than once per tier.
+int FinanceDb::compact(int64_t now) {
+    RetentionPolicy policy;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        policy = retention;
+    }
+    int removed = 0;
+    try {
+        for (auto tier = policy.rbegin(); tier != policy.rend(); ++tier) {
+            auto &&drop = tier->resolution == RETENTION_DROP;
+            auto &&block_ids = old_blocks(now - tier->age, drop ? INT64_MAX : tier->resolution);
+            for (auto &&block_id: block_ids) {
+                removed += drop ? drop_block(block_id) : downsample_block(block_id, tier->resolution);
+            }
+        }
+        if (removed > 0) reclaim_space();
+    }
+    catch (std::exception &ex) {
+        Logger::logger_inst->error("DB compact exception: {}", ex.what());
+        return -1;
+    }
+    if (removed > 0) Logger::logger_inst->info("Compacted away {} ticks", removed);
+    return removed;
+}
+
+// Walks the resolutions present one index seek at a time, so blocks that are already
+// compacted are never scanned.
+std::vector<int64_t> FinanceDb::old_blocks(int64_t cutoff, int64_t below_resolution) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    std::vector<int64_t> block_ids;
+    SQLite::Statement next_resolution(*db_ptr, "SELECT MIN(resolution) FROM finance_blocks WHERE resolution > ?");
+    SQLite::Statement query(*db_ptr, "SELECT id FROM finance_blocks WHERE resolution = ? AND end_time < ?"
+            " ORDER BY end_time LIMIT ?");
+    int64_t resolution = -1;
+    while (block_ids.size() < COMPACT_BATCH_BLOCKS) {
+        next_resolution.bind(1, resolution);
+        if (!next_resolution.executeStep() || next_resolution.getColumn(0).isNull()) break;
+        resolution = next_resolution.getColumn(0).getInt64();
+        next_resolution.reset();
+        if (resolution >= below_resolution) break;
+        query.bind(1, resolution);
+        query.bind(2, cutoff);
+        query.bind(3, static_cast<int64_t>(COMPACT_BATCH_BLOCKS - block_ids.size()));
+        while (query.executeStep()) {
+            block_ids.push_back(query.getColumn(0).getInt64());
+        }
+        query.reset();
+    }
+    return block_ids;
+}
+
+int FinanceDb::downsample_block(int64_t block_id, int64_t resolution) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    std::vector<codec::Tick> ticks;
+    {
+        SQLite::Statement query(*db_ptr, "SELECT count, data FROM finance_blocks WHERE id = ?");
+        query.bind(1, block_id);
+        if (!query.executeStep()) return 0;
+        auto &&count = static_cast<uint32_t>(query.getColumn(0).getInt());
+        auto &&data = query.getColumn(1);
+        TickBlockReader reader(std::string_view(static_cast<const char *>(data.getBlob()), data.getBytes()), count);
+        codec::Tick tick{};
+        while (reader.next(tick)) {
+            ticks.push_back(tick);
+        }
+    }
+    std::vector<codec::Tick> kept;
+    downsample(ticks, resolution, kept);
+    std::string data;
+    TickBlockWriter writer(data);
+    for (auto &&tick: kept) {
+        writer.add(tick);
+    }
+    writer.finish();
+    SQLite::Statement update(*db_ptr, "UPDATE finance_blocks SET start_time = ?, end_time = ?, count = ?, data = ?,"
+            " resolution = ? WHERE id = ?");
+    update.bind(1, static_cast<int64_t>(kept.empty() ? 0 : kept.front().timestamp));
+    update.bind(2, static_cast<int64_t>(kept.empty() ? 0 : kept.back().timestamp));
+    update.bind(3, static_cast<int>(writer.size()));
+    update.bind(4, data.data(), static_cast<int>(data.size()));
+    update.bind(5, resolution);
+    update.bind(6, block_id);
+    SQLite::Transaction transaction(*db_ptr);
+    update.exec();
+    transaction.commit();
+    return static_cast<int>(ticks.size() - kept.size());
+}
 
+int FinanceDb::drop_block(int64_t block_id) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    SQLite::Statement query(*db_ptr, "SELECT count FROM finance_blocks WHERE id = ?");
+    query.bind(1, block_id);
+    auto &&count = query.executeStep() ? query.getColumn(0).getInt() : 0;
+    query.reset();
+    SQLite::Statement remove_block(*db_ptr, "DELETE FROM finance_blocks WHERE id = ?");
+    remove_block.bind(1, block_id);
+    remove_block.exec();
+    return count;
+}
 
+void FinanceDb::reclaim_space() {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    db_ptr->exec("PRAGMA incremental_vacuum(" + std::to_string(COMPACT_VACUUM_PAGES) + ")");
+}
+
+void FinanceDb::update_quote(int64_t currency_id, int64_t id, double value, bool has_value) {
+    if (static_cast<size_t>(currency_id) >= quotes.size()) quotes.resize(currency_id + 1, LatestQuote{0, 0, false});
+    quotes[currency_id] = LatestQuote{id, value, has_value};
+    if (id > quotes_row_id) quotes_row_id = id;
+}
+
+void FinanceDb::load_quotes() {
+    auto &&start = std::chrono::steady_clock::now();
+    try {
+        SQLite::Statement state(*db_ptr, "SELECT generation FROM finance_state WHERE id = 0");
+        generation = state.executeStep() ? state.getColumn(0).getInt64() : 0;
+        auto &&from_snapshot = load_quotes_snapshot();
+        if (!from_snapshot) {
+            quotes.clear();
+            quotes_row_id = 0;
+        }
+        auto &&replayed = replay_quotes();
+        auto &&elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        auto &&loaded = std::count_if(quotes.begin(), quotes.end(), [](const LatestQuote &quote) {
+            return quote.id != 0;
+        });
+        Logger::logger_inst->info("Loaded {} quotes from {} and {} rows in {} ms", loaded,
+                                  from_snapshot ? "snapshot" : "scratch", replayed, elapsed);
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("DB quotes exception: {}", ex.what());
+    }
+}
+
+// Layout: u32 magic, u32 version, u64 checksum of the rest, i64 generation, i64 last row id,
+// then every currency id with the id and value of its latest row.
+bool FinanceDb::load_quotes_snapshot() {
+    MappedFile file;
+    if (!file.open(path + QUOTES_SUFFIX)) return false;
+    auto in = file.data();
+    uint32_t magic, version;
+    uint64_t snapshot_checksum;
+    int64_t snapshot_generation;
+    if (!codec::read_pod(in, magic) || !codec::read_pod(in, version) || !codec::read_pod(in, snapshot_checksum) ||
+        magic != QUOTES_MAGIC || version != QUOTES_VERSION || snapshot_checksum != codec::checksum(in)) {
+        Logger::logger_inst->error("Damaged quotes snapshot {}", path + QUOTES_SUFFIX);
+        return false;
+    }
+    if (!codec::read_pod(in, snapshot_generation) || snapshot_generation != generation ||
+        !codec::read_pod(in, quotes_row_id)) {
+        return false;
+    }
+    while (!in.empty()) {
+        int64_t currency_id;
+        LatestQuote quote{};
+        uint8_t has_value;
+        if (!codec::read_pod(in, currency_id) || !codec::read_pod(in, quote.id) ||
+            !codec::read_pod(in, quote.value) || !codec::read_pod(in, has_value) ||
+            currency_id <= 0 || currency_id > symbols.max_id()) {
+            return false;
+        }
+        update_quote(currency_id, quote.id, quote.value, has_value != 0);
+    }
+    return true;
+}
+
+size_t FinanceDb::replay_quotes() {
+    SQLite::Statement query(*db_ptr, "SELECT id, currency_id, value FROM finance WHERE id > ? ORDER BY id");
+    query.bind(1, static_cast<int64_t>(quotes_row_id));
+    size_t replayed = 0;
+    while (query.executeStep()) {
+        auto &&value = query.getColumn(2);
+        update_quote(query.getColumn(1).getInt64(), query.getColumn(0).getInt64(),
+                     value.isNull() ? 0 : value.getDouble(), !value.isNull());
+        ++replayed;
+    }
+    return replayed;
+}
+
+int FinanceDb::save_quotes() {
+    std::string body;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        codec::write_pod(body, generation);
+        codec::write_pod(body, quotes_row_id);
+        for (size_t currency_id = 1; currency_id < quotes.size(); ++currency_id) {
+            auto &&quote = quotes[currency_id];
+            if (quote.id == 0) continue;
+            codec::write_pod(body, static_cast<int64_t>(currency_id));
+            codec::write_pod(body, quote.id);
+            codec::write_pod(body, quote.value);
+            codec::write_pod(body, static_cast<uint8_t>(quote.has_value));
+        }
+    }
+    std::string data;
+    codec::write_pod(data, static_cast<uint32_t>(QUOTES_MAGIC));
+    codec::write_pod(data, static_cast<uint32_t>(QUOTES_VERSION));
+    codec::write_pod(data, codec::checksum(body));
+    data += body;
+    return replace_file(path + QUOTES_SUFFIX, data) ? 0 : -1;
+}
@@ -2,45 +2,129 @@
 #define ECHOSERVER_FINANCE_DB_H
 
 #include <SQLiteCpp/SQLiteCpp.h>
-#include <sstream>
-#include <iomanip>
 #include <mutex>
+#include <vector>
+
+#include "CurrencySymbols.h"
+#include "FinanceStorage.h"
+#include "Retention.h"
+
+#define FINANCE_DB_PATH "finance.db"
+#define QUOTES_SUFFIX ".quotes"
+#define QUOTES_MAGIC 0x544f5551u
+#define QUOTES_VERSION 2
+#define FINANCE_CURRENCY_INDEX "finance_currency"
+#define FINANCE_CURRENCY_INDEX_SQL "CREATE INDEX IF NOT EXISTS " FINANCE_CURRENCY_INDEX " ON finance (currency_id, id)"
+#define SEAL_BATCH_ROWS 4096
+#define SEAL_BATCH_WINDOWS 64
+#define COMPACT_BATCH_BLOCKS 1024
+#define COMPACT_VACUUM_PAGES 4096
+
+// A quote with row id 0 belongs to a currency that does not exist.
+struct LatestQuote {
+    int64_t id;
+    double value;
+    bool has_value;
+};
 
-#include "json/src/json.hpp"
+// Currency codes are stored once in the currencies table and rows refer to them by id. The
+// latest row of every currency is cached in memory by that id, which is what writes need. The
+// cache is saved next to the database and reloaded on start together with the rows added
+// after it. A deleted currency bumps the generation in finance_state and makes the saved
+// cache stale, so the next start rebuilds it from the whole table. The database is kept
+// in WAL mode so that reads take a snapshot on a connection of their own without blocking
+// writes; history and list reads share one read-only connection, exports open their own.
+// maintain() seals rows older than the current window into blocks and then rewrites old blocks
+// according to the retention policy, a bounded number of blocks per call, each in its own
+// short transaction; freed pages are returned by incremental vacuum. The policy is empty and
+// keeps every tick until set_retention() is called.
+class FinanceDb : public FinanceStorage {
+public:
+    explicit FinanceDb(const std::string &path = FINANCE_DB_PATH);
 
-struct FinanceUnit {
-    std::string currency;
-    float value;
-    float inc_rel;
-    float inc_abs;
-    std::tm date;
-};
+    ~FinanceDb() override;
 
+    FinanceDb(const FinanceDb &) = delete;
 
-class FinanceDb {
-public:
-    FinanceDb() : db_ptr(new SQLite::Database("finance.db", SQLite::OPEN_READWRITE)), db_mutex() {}
+    FinanceDb &operator=(const FinanceDb &) = delete;
+
+
+    static void reset(const std::string &path = FINANCE_DB_PATH);
+
+    // Creates missing tables and moves a database that still keeps currency codes in every
+    // row over to currency ids.
+    static void upgrade_schema(SQLite::Database &db);
 
-    virtual ~FinanceDb() = default;
+    int insert(FinanceUnit &financeUnit) override;
 
+    int add_currency(std::string &currency) override;
 
-    static void reset();
+    int add_currency_value(std::string &currency, double value, FinanceUnit *added = nullptr) override;
 
-    int insert(FinanceUnit &financeUnit);
+    int del_currency(std::string &currency) override;
 
-    int add_currency(std::string &currency);
+    int currency_history(std::string &currency, std::vector<FinanceUnit> &units) override;
 
-    int add_currency_value(std::string &currency, double value);
+    int currency_values(std::string &currency, std::vector<FinanceUnit> &units) override;
 
-    int del_currency(std::string &currency);
+    int currency_list(std::vector<FinanceUnit> &units) override;
 
-    int currency_history(std::string &currency, nlohmann::json& json);
+    int maintain(int64_t now) override;
 
-    int currency_list(nlohmann::json& json);
+    int export_units(const std::vector<std::string> &currencies, const ExportSink &sink) override;
+
+    int seal_blocks(int64_t window_seconds, int64_t now);
+
+    void set_retention(const RetentionPolicy &policy) override;
+
+    // Returns the number of ticks removed from blocks.
+    int compact(int64_t now);
 
 private:
+    static void create_aux_tables(SQLite::Database &db);
+
+    void load_symbols();
+
+    int64_t intern(const std::string &currency);
+
+    LatestQuote *find_quote(const std::string &currency);
+
+    void load_quotes();
+
+    bool load_quotes_snapshot();
+
+    size_t replay_quotes();
+
+    void update_quote(int64_t currency_id, int64_t id, double value, bool has_value);
+
+    int save_quotes();
+
+    int seal_currency(int64_t currency_id, int64_t window_seconds, int64_t boundary);
+
+    int seal_batch(int64_t currency_id, int64_t window_seconds, int64_t boundary, int64_t &after);
+
+    int read_history(std::string &currency, std::vector<FinanceUnit> &units, bool with_placeholder);
+
+    void read_blocks(SQLite::Statement &query, std::vector<FinanceUnit> &units);
+
+    std::vector<int64_t> old_blocks(int64_t cutoff, int64_t below_resolution);
+
+    int downsample_block(int64_t block_id, int64_t resolution);
+
+    int drop_block(int64_t block_id);
+
+    void reclaim_space();
+
+    std::string path;
     SQLite::Database *db_ptr;
     std::mutex db_mutex;
+    SQLite::Database *read_ptr;
+    std::mutex read_mutex;
+    CurrencySymbols symbols;
+    std::vector<LatestQuote> quotes;
+    RetentionPolicy retention;
+    int64_t quotes_row_id;
+    int64_t generation;
 };
 
 
@@ -0,0 +1,165 @@
+#include "FinanceStorage.h"
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <unordered_map>
+#include "logging/logger.h"
+#include "protocol/json_writer.h"
+
+std::tm parse_date(const std::string &date_str) {
+    std::tm datetime = {};
+    std::istringstream ss(date_str);
+    ss >> std::get_time(&datetime, DATE_FORMAT);
+    datetime.tm_isdst = -1;
+    return datetime;
+}
+
+std::tm timestamp_to_date(int64_t timestamp) {
+    auto &&time = static_cast<std::time_t>(timestamp);
+    std::tm date = {};
+#ifdef _WIN32
+    localtime_s(&date, &time);
+#else
+    localtime_r(&time, &date);
+#endif
+    return date;
+}
+
+int64_t date_to_timestamp(std::tm date) {
+    date.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&date));
+}
+
+std::string format_date(const std::tm &date) {
+    std::stringstream ss;
+    ss << std::put_time(&date, DATE_FORMAT);
+    return ss.str();
+}
+
+std::vector<codec::Series> units_to_series(std::vector<FinanceUnit> &units) {
+    std::vector<codec::Series> series;
+    std::unordered_map<std::string, size_t> index;
+    for (auto &&unit: units) {
+        auto &&position = index.emplace(unit.currency, series.size());
+        if (position.second) series.push_back(codec::Series{unit.currency, {}});
+        auto &&timestamp = date_to_timestamp(unit.date);
+        series[position.first->second].ticks.push_back({timestamp, unit.value, unit.inc_rel, unit.inc_abs});
+    }
+    return series;
+}
+
+bool replace_file(const std::string &path, std::string_view data) {
+    auto &&temporary_path = path + ".tmp";
+    try {
+        {
+            std::ofstream out(temporary_path, std::ios::binary | std::ios::trunc);
+            out.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!out.flush()) return false;
+        }
+        std::filesystem::rename(temporary_path, path);
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("File write exception: {}", ex.what());
+        return false;
+    }
+    return true;
+}
+
+namespace {
+    void write_date(protocol::JsonWriter &writer, const std::tm &date) {
+        char buffer[64];
+        auto &&length = std::strftime(buffer, sizeof(buffer), DATE_FORMAT, &date);
+        writer.value(std::string_view(buffer, length));
+    }
+}
+
+// An empty list is written as null, as it always was.
+void list_json(const std::vector<FinanceUnit> &units, std::string &out) {
+    if (units.empty()) {
+        out.append("null");
+        return;
+    }
+    protocol::JsonWriter writer(out);
+    writer.begin_array();
+    for (auto &&unit: units) {
+        writer.begin_object();
+        writer.key("absolute_increase");
+        writer.value(unit.inc_abs);
+        writer.key("currency");
+        writer.value(unit.currency);
+        writer.key("date");
+        write_date(writer, unit.date);
+        writer.key("relative_increase");
+        writer.value(unit.inc_rel);
+        writer.key("value");
+        writer.value(unit.value);
+        writer.end_object();
+    }
+    writer.end_array();
+}
+
+void history_json(const std::string &currency, const std::vector<FinanceUnit> &units, std::string &out) {
+    protocol::JsonWriter writer(out);
+    writer.begin_object();
+    writer.key("currency");
+    writer.value(currency);
+    writer.key("history");
+    if (units.empty()) {
+        writer.null();
+    } else {
+        writer.begin_array();
+        for (auto &&unit: units) {
+            writer.begin_object();
+            writer.key("date");
+            write_date(writer, unit.date);
+            writer.key("value");
+            writer.value(unit.value);
+            writer.end_object();
+        }
+        writer.end_array();
+    }
+    writer.end_object();
+}
+
+int FinanceStorage::currency_list_json(std::string &out) {
+    std::vector<FinanceUnit> units;
+    auto &&status = currency_list(units);
+    if (status == 0) list_json(units, out);
+    return status;
+}
+
+int FinanceStorage::currency_history_json(std::string &currency, std::string &out) {
+    std::vector<FinanceUnit> units;
+    auto &&status = currency_history(currency, units);
+    if (status == 0) history_json(currency, units, out);
+    return status;
+}
+
+int FinanceStorage::export_units(const std::vector<std::string> &currencies, const ExportSink &sink) {
+    auto names = currencies;
+    if (names.empty()) {
+        std::vector<FinanceUnit> units;
+        auto &&status = currency_list(units);
+        if (status != 0) return status;
+        std::set<std::string> unique_names;
+        for (auto &&unit: units) {
+            unique_names.insert(unit.currency);
+        }
+        names.assign(unique_names.begin(), unique_names.end());
+    }
+    std::vector<FinanceUnit> batch;
+    for (auto &&name: names) {
+        std::vector<FinanceUnit> units;
+        auto &&status = currency_values(name, units);
+        if (status < 0) return status;
+        if (status == 1 || units.empty()) continue;
+        for (auto &&unit: units) {
+            batch.emplace_back(std::move(unit));
+        }
+        if (batch.size() >= EXPORT_BATCH_ROWS) {
+            if (!sink(batch)) return -1;
+            batch.clear();
+        }
+    }
+    if (!batch.empty() && !sink(batch)) return -1;
+    return 0;
+}
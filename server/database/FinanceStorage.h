@@ -0,0 +1,91 @@
+#ifndef ECHOSERVER_FINANCE_STORAGE_H
+#define ECHOSERVER_FINANCE_STORAGE_H
+
+#include <sstream>
+#include <iomanip>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "codec/series_codec.h"
+#include "Retention.h"
+
+#define DATE_FORMAT "%Y-%b-%d %H:%M:%S"
+#define EXPORT_BATCH_ROWS 4096
+
+struct FinanceUnit {
+    std::string currency;
+    double value;
+    double inc_rel;
+    double inc_abs;
+    std::tm date;
+};
+
+std::tm parse_date(const std::string &date_str);
+
+std::tm timestamp_to_date(int64_t timestamp);
+
+int64_t date_to_timestamp(std::tm date);
+
+std::string format_date(const std::tm &date);
+
+std::vector<codec::Series> units_to_series(std::vector<FinanceUnit> &units);
+
+// Append the JSON bodies of the list and history responses to out, keys in sorted order.
+void list_json(const std::vector<FinanceUnit> &units, std::string &out);
+
+void history_json(const std::string &currency, const std::vector<FinanceUnit> &units, std::string &out);
+
+// Writes data next to path and renames it over path, so readers see the old or the new file.
+bool replace_file(const std::string &path, std::string_view data);
+
+
+// Receives the rows of an export a batch at a time and may keep their contents. Returning
+// false stops the export.
+using ExportSink = std::function<bool(std::vector<FinanceUnit> &)>;
+
+// Operations return 0 on success, 1 when the currency is missing (or already exists for
+// add_currency) and -1 when the engine failed.
+class FinanceStorage {
+public:
+    virtual ~FinanceStorage() = default;
+
+    virtual int insert(FinanceUnit &financeUnit) = 0;
+
+    virtual int add_currency(std::string &currency) = 0;
+
+    // When added is given, it receives the row that was stored, increments and date included.
+    virtual int add_currency_value(std::string &currency, double value, FinanceUnit *added = nullptr) = 0;
+
+    virtual int del_currency(std::string &currency) = 0;
+
+    virtual int currency_history(std::string &currency, std::vector<FinanceUnit> &units) = 0;
+
+    // Like currency_history, but a currency without values leaves units empty instead of
+    // getting the zero row that stands in for it in replies.
+    virtual int currency_values(std::string &currency, std::vector<FinanceUnit> &units) = 0;
+
+    virtual int currency_list(std::vector<FinanceUnit> &units) = 0;
+
+    // Periodic housekeeping, run from the server timer on a worker thread.
+    virtual int maintain(int64_t now) {
+        return 0;
+    }
+
+    // How maintain() thins out old data; engines that keep every tick ignore it.
+    virtual void set_retention(const RetentionPolicy &policy) {}
+
+    // Passes the rows of the given currencies, or of all of them, to sink in batches of
+    // about EXPORT_BATCH_ROWS, grouped by currency and skipping currencies without values.
+    // Returns -1 as soon as the sink stops it. This default reads one currency at a time,
+    // so only each currency is consistent.
+    virtual int export_units(const std::vector<std::string> &currencies, const ExportSink &sink);
+
+    int currency_history_json(std::string &currency, std::string &out);
+
+    int currency_list_json(std::string &out);
+};
+
+
+#endif
@@ -0,0 +1,82 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path) {
+    close();
+    auto &&file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    file_handle = file;
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size)) {
+        close();
+        return false;
+    }
+    data_size = static_cast<size_t>(size.QuadPart);
+    if (data_size == 0) return true;
+    mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle == nullptr) {
+        close();
+        return false;
+    }
+    data_ptr = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (data_ptr == nullptr) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_ptr != nullptr) UnmapViewOfFile(data_ptr);
+    if (mapping_handle != nullptr) CloseHandle(mapping_handle);
+    if (file_handle != nullptr) CloseHandle(file_handle);
+    data_ptr = nullptr;
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+    data_size = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string &path) {
+    close();
+    auto &&descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat file_stat{};
+    if (fstat(descriptor, &file_stat) != 0) {
+        ::close(descriptor);
+        return false;
+    }
+    data_size = static_cast<size_t>(file_stat.st_size);
+    if (data_size > 0) {
+        auto &&mapped = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(descriptor);
+            data_size = 0;
+            return false;
+        }
+        madvise(mapped, data_size, MADV_SEQUENTIAL);
+        data_ptr = mapped;
+    }
+    ::close(descriptor);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_ptr != nullptr) munmap(data_ptr, data_size);
+    data_ptr = nullptr;
+    data_size = 0;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef ECHOSERVER_MAPPED_FILE_H
+#define ECHOSERVER_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole file mapped into memory.
+class MappedFile {
+public:
+    MappedFile() : data_ptr(nullptr), data_size(0), file_handle(nullptr), mapping_handle(nullptr) {}
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path);
+
+    void close();
+
+    std::string_view data() const {
+        return std::string_view(static_cast<const char *>(data_ptr), data_size);
+    }
+
+private:
+    void *data_ptr;
+    size_t data_size;
+    void *file_handle;
+    void *mapping_handle;
+};
+
+
+#endif
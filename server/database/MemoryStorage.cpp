@@ -0,0 +1,307 @@
+#include "MemoryStorage.h"
+#include "MappedFile.h"
+#include <filesystem>
+#include <stdexcept>
+#include "codec/binary_io.h"
+#include "logging/logger.h"
+
+#define WAL_ADD_CURRENCY 1
+#define WAL_ADD_TICK 2
+#define WAL_DEL_CURRENCY 3
+
+namespace {
+    FinanceUnit tick_unit(const std::string &currency, const codec::Tick &tick) {
+        return FinanceUnit{currency, tick.value, tick.inc_rel, tick.inc_abs, timestamp_to_date(tick.timestamp)};
+    }
+
+    void series_units(const std::string &currency, CurrencySeries &series, std::vector<FinanceUnit> &units) {
+        std::lock_guard<std::mutex> lock(series.mutex);
+        if (series.ticks.empty()) {
+            units.push_back(tick_unit(currency, codec::Tick{series.created, 0, 0, 0}));
+            return;
+        }
+        for (auto &&tick: series.ticks) {
+            units.push_back(tick_unit(currency, tick));
+        }
+    }
+}
+
+MemoryStorage::MemoryStorage(const std::string &path) :
+        path(path), wal(nullptr), sequence(0), snapshot_sequence(0) {
+    load_snapshot();
+    replay_wal(path + WAL_ROTATED_SUFFIX);
+    replay_wal(path + WAL_SUFFIX);
+    // Start from a clean snapshot so that a torn record at the end of the old log is never
+    // followed by new ones.
+    if (!replace_file(path + SNAPSHOT_SUFFIX, serialize(sequence))) {
+        throw std::runtime_error("Cannot write snapshot " + path + SNAPSHOT_SUFFIX);
+    }
+    snapshot_sequence = sequence;
+    std::remove((path + WAL_ROTATED_SUFFIX).c_str());
+    wal = std::fopen((path + WAL_SUFFIX).c_str(), "wb");
+    if (wal == nullptr) {
+        throw std::runtime_error("Cannot open write-ahead log " + path + WAL_SUFFIX);
+    }
+    Logger::logger_inst->info("Memory storage loaded {} currencies at sequence {}", currencies.size(), sequence);
+}
+
+MemoryStorage::~MemoryStorage() {
+    write_snapshot();
+    if (wal != nullptr) std::fclose(wal);
+}
+
+void MemoryStorage::reset(const std::string &path) {
+    Logger::logger_inst->info("Resetting memory storage");
+    std::remove((path + SNAPSHOT_SUFFIX).c_str());
+    std::remove((path + WAL_SUFFIX).c_str());
+    std::remove((path + WAL_ROTATED_SUFFIX).c_str());
+}
+
+int MemoryStorage::insert(FinanceUnit &financeUnit) {
+    try {
+        codec::Tick tick{date_to_timestamp(financeUnit.date), financeUnit.value, financeUnit.inc_rel,
+                         financeUnit.inc_abs};
+        std::unique_lock<std::shared_mutex> lock(currencies_mutex);
+        append_wal(WAL_ADD_TICK, financeUnit.currency, tick);
+        apply(WAL_ADD_TICK, financeUnit.currency, tick);
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("Memory storage insert exception: {}", ex.what());
+        return -1;
+    }
+    return 0;
+}
+
+int MemoryStorage::add_currency(std::string &currency) {
+    try {
+        std::unique_lock<std::shared_mutex> lock(currencies_mutex);
+        if (currencies.find(currency) != currencies.end()) return 1;
+        codec::Tick tick{static_cast<int64_t>(time(nullptr)), 0, 0, 0};
+        append_wal(WAL_ADD_CURRENCY, currency, tick);
+        apply(WAL_ADD_CURRENCY, currency, tick);
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("Memory storage exception: {}", ex.what());
+        return -1;
+    }
+    return 0;
+}
+
+int MemoryStorage::add_currency_value(std::string &currency, double value, FinanceUnit *added) {
+    try {
+        std::shared_lock<std::shared_mutex> lock(currencies_mutex);
+        auto &&found = currencies.find(currency);
+        if (found == currencies.end()) return 1;
+        auto &&series = *found->second;
+        std::lock_guard<std::mutex> series_lock(series.mutex);
+        codec::Tick tick{static_cast<int64_t>(time(nullptr)), value, 0, 0};
+        if (!series.ticks.empty()) {
+            auto &&previous = series.ticks.back().value;
+            tick.inc_abs = value - previous;
+            tick.inc_rel = tick.inc_abs / previous;
+        }
+        append_wal(WAL_ADD_TICK, currency, tick);
+        series.ticks.push_back(tick);
+        if (added != nullptr) *added = tick_unit(currency, tick);
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("Memory storage exception: {}", ex.what());
+        return -1;
+    }
+    return 0;
+}
+
+int MemoryStorage::del_currency(std::string &currency) {
+    try {
+        std::unique_lock<std::shared_mutex> lock(currencies_mutex);
+        if (currencies.find(currency) == currencies.end()) return 1;
+        codec::Tick tick{static_cast<int64_t>(time(nullptr)), 0, 0, 0};
+        append_wal(WAL_DEL_CURRENCY, currency, tick);
+        apply(WAL_DEL_CURRENCY, currency, tick);
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("Memory storage exception: {}", ex.what());
+        return -1;
+    }
+    return 0;
+}
+
+int MemoryStorage::currency_history(std::string &currency, std::vector<FinanceUnit> &units) {
+    std::shared_lock<std::shared_mutex> lock(currencies_mutex);
+    auto &&found = currencies.find(currency);
+    if (found == currencies.end()) return 1;
+    series_units(currency, *found->second, units);
+    return 0;
+}
+
+int MemoryStorage::currency_values(std::string &currency, std::vector<FinanceUnit> &units) {
+    std::shared_lock<std::shared_mutex> lock(currencies_mutex);
+    auto &&found = currencies.find(currency);
+    if (found == currencies.end()) return 1;
+    auto &&series = *found->second;
+    std::lock_guard<std::mutex> series_lock(series.mutex);
+    for (auto &&tick: series.ticks) {
+        units.push_back(tick_unit(currency, tick));
+    }
+    return 0;
+}
+
+int MemoryStorage::currency_list(std::vector<FinanceUnit> &units) {
+    std::shared_lock<std::shared_mutex> lock(currencies_mutex);
+    for (auto &&entry: currencies) {
+        series_units(entry.first, *entry.second, units);
+    }
+    return 0;
+}
+
+int MemoryStorage::maintain(int64_t now) {
+    {
+        std::lock_guard<std::mutex> lock(wal_mutex);
+        if (sequence == snapshot_sequence) return 0;
+    }
+    return write_snapshot();
+}
+
+// Record layout: u32 body size, body, u64 checksum of the body.
+// Body: u64 sequence, u8 operation, currency, tick.
+void MemoryStorage::append_wal(uint8_t op, const std::string &currency, const codec::Tick &tick) {
+    std::lock_guard<std::mutex> lock(wal_mutex);
+    if (wal == nullptr) throw std::runtime_error("Write-ahead log is closed");
+    std::string body;
+    codec::write_pod(body, sequence + 1);
+    codec::write_pod(body, op);
+    codec::write_string(body, currency);
+    codec::write_pod(body, tick);
+    std::string record;
+    codec::write_pod(record, static_cast<uint32_t>(body.size()));
+    record += body;
+    codec::write_pod(record, codec::checksum(body));
+    if (std::fwrite(record.data(), 1, record.size(), wal) != record.size() || std::fflush(wal) != 0) {
+        throw std::runtime_error("Write-ahead log append failed");
+    }
+    ++sequence;
+}
+
+void MemoryStorage::replay_wal(const std::string &wal_path) {
+    MappedFile file;
+    if (!file.open(wal_path)) return;
+    auto in = file.data();
+    size_t replayed = 0;
+    while (!in.empty()) {
+        uint32_t size;
+        uint64_t record_sequence = 0, record_checksum = 0;
+        uint8_t op;
+        std::string_view body, currency;
+        codec::Tick tick{};
+        if (!codec::read_pod(in, size) || in.size() < size + sizeof(uint64_t)) break;
+        body = in.substr(0, size);
+        in.remove_prefix(size);
+        codec::read_pod(in, record_checksum);
+        if (record_checksum != codec::checksum(body)) break;
+        if (!codec::read_pod(body, record_sequence) || !codec::read_pod(body, op) ||
+            !codec::read_string(body, currency) || !codec::read_pod(body, tick)) {
+            break;
+        }
+        if (record_sequence <= sequence) continue;
+        apply(op, std::string(currency), tick);
+        sequence = record_sequence;
+        ++replayed;
+    }
+    if (!in.empty()) {
+        Logger::logger_inst->error("Write-ahead log {} has a damaged tail of {} bytes", wal_path, in.size());
+    }
+    if (replayed > 0) Logger::logger_inst->info("Replayed {} records from {}", replayed, wal_path);
+}
+
+void MemoryStorage::apply(uint8_t op, const std::string &currency, const codec::Tick &tick) {
+    if (op == WAL_DEL_CURRENCY) {
+        currencies.erase(currency);
+        return;
+    }
+    auto &&found = currencies.find(currency);
+    if (found == currencies.end()) {
+        found = currencies.emplace(currency, std::make_unique<CurrencySeries>()).first;
+        found->second->created = tick.timestamp;
+    }
+    if (op == WAL_ADD_TICK) {
+        found->second->ticks.push_back(tick);
+    }
+}
+
+// Layout: u32 magic, u32 version, u64 sequence, u64 checksum of the rest, then for every
+// currency its name, u64 creation time, u64 tick count and the ticks themselves.
+std::string MemoryStorage::serialize(uint64_t snapshot_sequence) {
+    std::string body;
+    for (auto &&entry: currencies) {
+        auto &&series = *entry.second;
+        codec::write_string(body, entry.first);
+        codec::write_pod(body, series.created);
+        codec::write_pod(body, static_cast<uint64_t>(series.ticks.size()));
+        body.append(reinterpret_cast<const char *>(series.ticks.data()), series.ticks.size() * sizeof(codec::Tick));
+    }
+    std::string data;
+    codec::write_pod(data, static_cast<uint32_t>(SNAPSHOT_MAGIC));
+    codec::write_pod(data, static_cast<uint32_t>(SNAPSHOT_VERSION));
+    codec::write_pod(data, snapshot_sequence);
+    codec::write_pod(data, codec::checksum(body));
+    data += body;
+    return data;
+}
+
+void MemoryStorage::load_snapshot() {
+    MappedFile file;
+    if (!file.open(path + SNAPSHOT_SUFFIX)) return;
+    auto in = file.data();
+    uint32_t magic, version;
+    uint64_t snapshot_checksum;
+    if (!codec::read_pod(in, magic) || !codec::read_pod(in, version) || !codec::read_pod(in, sequence) ||
+        !codec::read_pod(in, snapshot_checksum) || magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION ||
+        snapshot_checksum != codec::checksum(in)) {
+        throw std::runtime_error("Damaged snapshot " + path + SNAPSHOT_SUFFIX);
+    }
+    while (!in.empty()) {
+        std::string_view currency;
+        int64_t created;
+        uint64_t count;
+        if (!codec::read_string(in, currency) || !codec::read_pod(in, created) || !codec::read_pod(in, count) ||
+            in.size() < count * sizeof(codec::Tick)) {
+            throw std::runtime_error("Damaged snapshot " + path + SNAPSHOT_SUFFIX);
+        }
+        auto &&series = std::make_unique<CurrencySeries>();
+        series->created = created;
+        series->ticks.resize(count);
+        std::memcpy(series->ticks.data(), in.data(), count * sizeof(codec::Tick));
+        in.remove_prefix(count * sizeof(codec::Tick));
+        currencies.emplace(std::string(currency), std::move(series));
+    }
+    snapshot_sequence = sequence;
+}
+
+// The state is copied and the log rotated while writers are held off; the file itself is
+// written without blocking them. The rotated log is only dropped once the snapshot that
+// covers it is on disk. If an earlier snapshot failed, the rotated log is still there and
+// the current one keeps growing instead, which replay handles through the sequence numbers.
+int MemoryStorage::write_snapshot() {
+    std::unique_lock<std::mutex> snapshot_lock(snapshot_mutex, std::try_to_lock);
+    if (!snapshot_lock.owns_lock()) return 0;
+    std::string data;
+    uint64_t data_sequence;
+    {
+        std::unique_lock<std::shared_mutex> lock(currencies_mutex);
+        std::lock_guard<std::mutex> wal_lock(wal_mutex);
+        data_sequence = sequence;
+        data = serialize(data_sequence);
+        auto &&wal_path = path + WAL_SUFFIX;
+        auto &&rotated_path = path + WAL_ROTATED_SUFFIX;
+        if (wal != nullptr && !std::filesystem::exists(rotated_path)) {
+            std::fclose(wal);
+            std::rename(wal_path.c_str(), rotated_path.c_str());
+            wal = std::fopen(wal_path.c_str(), "ab");
+            if (wal == nullptr) {
+                Logger::logger_inst->error("Cannot reopen write-ahead log {}", wal_path);
+            }
+        }
+    }
+    if (!replace_file(path + SNAPSHOT_SUFFIX, data)) return -1;
+    std::remove((path + WAL_ROTATED_SUFFIX).c_str());
+    std::lock_guard<std::mutex> wal_lock(wal_mutex);
+    snapshot_sequence = data_sequence;
+    Logger::logger_inst->info("Snapshot written at sequence {}, {} bytes", data_sequence, data.size());
+    return 0;
+}
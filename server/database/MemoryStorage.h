@@ -0,0 +1,80 @@
+#ifndef ECHOSERVER_MEMORY_STORAGE_H
+#define ECHOSERVER_MEMORY_STORAGE_H
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
+#include "FinanceStorage.h"
+
+#define MEMORY_STORAGE_PATH "finance_mem"
+#define WAL_SUFFIX ".wal"
+#define WAL_ROTATED_SUFFIX ".wal.old"
+#define SNAPSHOT_SUFFIX ".snap"
+#define SNAPSHOT_MAGIC 0x50414e53u
+#define SNAPSHOT_VERSION 1
+
+struct CurrencySeries {
+    std::mutex mutex;
+    int64_t created = 0;
+    std::vector<codec::Tick> ticks;
+};
+
+// Keeps every currency in memory. A change is appended to the write-ahead log before it
+// is applied, and maintain() folds the log into a snapshot. The log is flushed to the OS
+// after each record but not synced, so only a crash of the whole machine loses writes.
+class MemoryStorage : public FinanceStorage {
+public:
+    explicit MemoryStorage(const std::string &path = MEMORY_STORAGE_PATH);
+
+    ~MemoryStorage() override;
+
+    MemoryStorage(const MemoryStorage &) = delete;
+
+    MemoryStorage &operator=(const MemoryStorage &) = delete;
+
+    static void reset(const std::string &path = MEMORY_STORAGE_PATH);
+
+    int insert(FinanceUnit &financeUnit) override;
+
+    int add_currency(std::string &currency) override;
+
+    int add_currency_value(std::string &currency, double value, FinanceUnit *added = nullptr) override;
+
+    int del_currency(std::string &currency) override;
+
+    int currency_history(std::string &currency, std::vector<FinanceUnit> &units) override;
+
+    int currency_values(std::string &currency, std::vector<FinanceUnit> &units) override;
+
+    int currency_list(std::vector<FinanceUnit> &units) override;
+
+    int maintain(int64_t now) override;
+
+private:
+    void append_wal(uint8_t op, const std::string &currency, const codec::Tick &tick);
+
+    void replay_wal(const std::string &wal_path);
+
+    void apply(uint8_t op, const std::string &currency, const codec::Tick &tick);
+
+    void load_snapshot();
+
+    std::string serialize(uint64_t snapshot_sequence);
+
+    int write_snapshot();
+
+    std::string path;
+    std::map<std::string, std::unique_ptr<CurrencySeries>> currencies;
+    std::shared_mutex currencies_mutex;
+    std::mutex wal_mutex;
+    std::mutex snapshot_mutex;
+    std::FILE *wal;
+    uint64_t sequence;
+    uint64_t snapshot_sequence;
+};
+
+
+#endif
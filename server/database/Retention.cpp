@@ -0,0 +1,54 @@
+#include <sstream>
+#include "Retention.h"
+#include "TickBlock.h"
+
+namespace {
+    bool parse_seconds(const std::string &text, int64_t &seconds) {
+        static const int64_t units[] = {1, 60, 3600, 86400, 365 * 86400};
+        if (text.empty()) return false;
+        auto &&suffix = std::string("smhdy").find(text.back());
+        auto &&number = suffix == std::string::npos ? text : text.substr(0, text.size() - 1);
+        if (number.empty() || number.size() > 9 || number.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        seconds = std::stoll(number) * (suffix == std::string::npos ? 1 : units[suffix]);
+        return seconds > 0;
+    }
+}
+
+bool parse_retention(const std::string &text, RetentionPolicy &policy) {
+    policy.clear();
+    std::stringstream tiers(text);
+    std::string tier_text;
+    while (std::getline(tiers, tier_text, ',')) {
+        auto &&separator = tier_text.find(':');
+        if (separator == std::string::npos) return false;
+        RetentionTier tier{};
+        if (!parse_seconds(tier_text.substr(0, separator), tier.age)) return false;
+        auto &&resolution = tier_text.substr(separator + 1);
+        if (resolution == "drop") tier.resolution = RETENTION_DROP;
+        else if (!parse_seconds(resolution, tier.resolution) || tier.resolution > BLOCK_WINDOW_SECONDS) return false;
+        if (!policy.empty()) {
+            auto &&previous = policy.back();
+            if (previous.resolution == RETENTION_DROP || tier.age <= previous.age) return false;
+            if (tier.resolution != RETENTION_DROP && tier.resolution <= previous.resolution) return false;
+        }
+        policy.push_back(tier);
+    }
+    return true;
+}
+
+void downsample(const std::vector<codec::Tick> &ticks, int64_t resolution, std::vector<codec::Tick> &out) {
+    out.clear();
+    double growth = 1, change = 0;
+    for (size_t i = 0; i < ticks.size(); ++i) {
+        auto &&tick = ticks[i];
+        growth *= 1 + tick.inc_rel;
+        change += tick.inc_abs;
+        auto &&last = i + 1 == ticks.size() || ticks[i + 1].timestamp / resolution != tick.timestamp / resolution;
+        if (!last) continue;
+        out.push_back({tick.timestamp, tick.value, growth - 1, change});
+        growth = 1;
+        change = 0;
+    }
+}
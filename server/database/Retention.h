@@ -0,0 +1,32 @@
+#ifndef ECHOSERVER_RETENTION_H
+#define ECHOSERVER_RETENTION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "codec/series_codec.h"
+
+#define RETENTION_DROP 0
+
+// Data older than age seconds is kept at one tick per resolution seconds, or removed when
+// the resolution is RETENTION_DROP.
+struct RetentionTier {
+    int64_t age;
+    int64_t resolution;
+};
+
+// Tiers in order of age, each coarser than the one before; younger data keeps every tick.
+using RetentionPolicy = std::vector<RetentionTier>;
+
+// Reads a comma separated list of age:resolution such as "7d:60,90d:3600,5y:drop". Both take
+// an s, m, h, d or y suffix; an empty text keeps everything. Resolutions are at most
+// BLOCK_WINDOW_SECONDS because ticks are only merged within a block.
+bool parse_retention(const std::string &text, RetentionPolicy &policy);
+
+// Keeps the last tick of every resolution aligned interval. Its changes are accumulated
+// over the interval, so the kept ticks still add up to the same values.
+void downsample(const std::vector<codec::Tick> &ticks, int64_t resolution, std::vector<codec::Tick> &out);
+
+
+#endif
@@ -0,0 +1,120 @@
+#include "ShardedStorage.h"
+#include <future>
+#include "codec/binary_io.h"
+#include "logging/logger.h"
+
+ShardedStorage::ShardedStorage(const std::string &path, size_t shard_count) {
+    for (size_t i = 0; i < shard_count; ++i) {
+        Shard shard;
+        shard.database = std::make_unique<FinanceDb>(shard_path(path, i));
+        shard.writer = std::make_unique<ThreadPool>(1);
+        shards.emplace_back(std::move(shard));
+    }
+    Logger::logger_inst->info("Opened {} database shards", shard_count);
+}
+
+void ShardedStorage::reset(const std::string &path, size_t shard_count) {
+    for (size_t i = 0; i < shard_count; ++i) {
+        FinanceDb::reset(shard_path(path, i));
+    }
+}
+
+std::string ShardedStorage::shard_path(const std::string &path, size_t shard) {
+    auto &&extension = path.rfind('.');
+    auto &&suffix = "_" + std::to_string(shard);
+    if (extension == std::string::npos || path.find_first_of("/\\", extension) != std::string::npos) {
+        return path + suffix;
+    }
+    return path.substr(0, extension) + suffix + path.substr(extension);
+}
+
+size_t ShardedStorage::shard_index(const std::string &currency) const {
+    return codec::checksum(currency) % shards.size();
+}
+
+Shard &ShardedStorage::shard_for(const std::string &currency) {
+    return shards[shard_index(currency)];
+}
+
+int ShardedStorage::insert(FinanceUnit &financeUnit) {
+    auto &&shard = shard_for(financeUnit.currency);
+    return shard.writer->enqueue([&] { return shard.database->insert(financeUnit); }).get();
+}
+
+int ShardedStorage::add_currency(std::string &currency) {
+    auto &&shard = shard_for(currency);
+    return shard.writer->enqueue([&] { return shard.database->add_currency(currency); }).get();
+}
+
+int ShardedStorage::add_currency_value(std::string &currency, double value, FinanceUnit *added) {
+    auto &&shard = shard_for(currency);
+    return shard.writer->enqueue([&] { return shard.database->add_currency_value(currency, value, added); }).get();
+}
+
+int ShardedStorage::del_currency(std::string &currency) {
+    auto &&shard = shard_for(currency);
+    return shard.writer->enqueue([&] { return shard.database->del_currency(currency); }).get();
+}
+
+int ShardedStorage::currency_history(std::string &currency, std::vector<FinanceUnit> &units) {
+    return shard_for(currency).database->currency_history(currency, units);
+}
+
+int ShardedStorage::currency_values(std::string &currency, std::vector<FinanceUnit> &units) {
+    return shard_for(currency).database->currency_values(currency, units);
+}
+
+int ShardedStorage::currency_list(std::vector<FinanceUnit> &units) {
+    std::vector<std::vector<FinanceUnit>> shard_units(shards.size());
+    std::vector<std::future<int>> results;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        auto &&database = *shards[i].database;
+        auto &&target = shard_units[i];
+        results.push_back(std::async(std::launch::async, [&database, &target] {
+            return database.currency_list(target);
+        }));
+    }
+    auto status = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        auto &&shard_status = results[i].get();
+        if (shard_status != 0) status = shard_status;
+        for (auto &&unit: shard_units[i]) {
+            units.emplace_back(std::move(unit));
+        }
+    }
+    return status;
+}
+
+int ShardedStorage::maintain(int64_t now) {
+    std::vector<std::future<int>> results;
+    for (auto &&shard: shards) {
+        auto &&database = *shard.database;
+        results.push_back(std::async(std::launch::async, [&database, now] { return database.maintain(now); }));
+    }
+    auto total = 0;
+    for (auto &&result: results) {
+        auto &&sealed = result.get();
+        if (sealed < 0) total = -1;
+        else if (total >= 0) total += sealed;
+    }
+    return total;
+}
+
+void ShardedStorage::set_retention(const RetentionPolicy &policy) {
+    for (auto &&shard: shards) {
+        shard.database->set_retention(policy);
+    }
+}
+
+int ShardedStorage::export_units(const std::vector<std::string> &currencies, const ExportSink &sink) {
+    std::vector<std::vector<std::string>> shard_currencies(shards.size());
+    for (auto &&currency: currencies) {
+        shard_currencies[shard_index(currency)].push_back(currency);
+    }
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (!currencies.empty() && shard_currencies[i].empty()) continue;
+        auto &&status = shards[i].database->export_units(shard_currencies[i], sink);
+        if (status != 0) return status;
+    }
+    return 0;
+}
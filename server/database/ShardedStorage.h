@@ -0,0 +1,63 @@
+#ifndef ECHOSERVER_SHARDED_STORAGE_H
+#define ECHOSERVER_SHARDED_STORAGE_H
+
+#include <memory>
+#include <vector>
+
+#include "thread_pool/ThreadPool.h"
+#include "FinanceDb.h"
+
+#define DEFAULT_SHARDS 4
+
+// The writer is declared last so that it is joined before the database is closed.
+struct Shard {
+    std::unique_ptr<FinanceDb> database;
+    std::unique_ptr<ThreadPool> writer;
+};
+
+// Spreads currencies over several FinanceDb files by a stable hash of the currency name.
+// Every shard has its own database and a single thread that runs its writes, so writes to
+// currencies on different shards do not wait for each other. Reads, exports and maintenance
+// go to the shards directly rather than through their writers: FinanceDb serves reads from
+// its own connection and takes its write lock for one batch of maintenance at a time, so
+// neither holds up the writer for long. Listing and maintenance run on all shards at once.
+// The files only make sense with the shard count they were created with.
+class ShardedStorage : public FinanceStorage {
+public:
+    explicit ShardedStorage(const std::string &path = FINANCE_DB_PATH, size_t shard_count = DEFAULT_SHARDS);
+
+    static void reset(const std::string &path = FINANCE_DB_PATH, size_t shard_count = DEFAULT_SHARDS);
+
+    static std::string shard_path(const std::string &path, size_t shard);
+
+    int insert(FinanceUnit &financeUnit) override;
+
+    int add_currency(std::string &currency) override;
+
+    int add_currency_value(std::string &currency, double value, FinanceUnit *added = nullptr) override;
+
+    int del_currency(std::string &currency) override;
+
+    int currency_history(std::string &currency, std::vector<FinanceUnit> &units) override;
+
+    int currency_values(std::string &currency, std::vector<FinanceUnit> &units) override;
+
+    int currency_list(std::vector<FinanceUnit> &units) override;
+
+    int maintain(int64_t now) override;
+
+    void set_retention(const RetentionPolicy &policy) override;
+
+    // Each shard is read as its own snapshot, one after another.
+    int export_units(const std::vector<std::string> &currencies, const ExportSink &sink) override;
+
+private:
+    size_t shard_index(const std::string &currency) const;
+
+    Shard &shard_for(const std::string &currency);
+
+    std::vector<Shard> shards;
+};
+
+
+#endif
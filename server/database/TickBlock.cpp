@@ -0,0 +1,91 @@
+#include "TickBlock.h"
+
+namespace {
+    struct DeltaBucket {
+        uint64_t prefix;
+        int prefix_bits;
+        int value_bits;
+    };
+
+    const DeltaBucket delta_buckets[] = {
+            {0b10,   2, 7},
+            {0b110,  3, 9},
+            {0b1110, 4, 12},
+    };
+}
+
+void TickBlockWriter::add(const codec::Tick &tick) {
+    write_timestamp(tick.timestamp);
+    values.add(tick.value);
+    inc_rel.add(tick.inc_rel);
+    inc_abs.add(tick.inc_abs);
+    ++count;
+}
+
+void TickBlockWriter::finish() {
+    writer.finish();
+}
+
+void TickBlockWriter::write_timestamp(int64_t timestamp) {
+    if (count == 0) {
+        writer.write_bits(static_cast<uint64_t>(timestamp), 64);
+        previous_timestamp = timestamp;
+        return;
+    }
+    auto &&delta = timestamp - previous_timestamp;
+    auto &&delta_of_delta = delta - previous_delta;
+    previous_timestamp = timestamp;
+    previous_delta = delta;
+    if (delta_of_delta == 0) {
+        writer.write_bit(false);
+        return;
+    }
+    for (auto &&bucket: delta_buckets) {
+        auto &&limit = int64_t(1) << (bucket.value_bits - 1);
+        if (delta_of_delta >= -limit + 1 && delta_of_delta <= limit) {
+            writer.write_bits(bucket.prefix, bucket.prefix_bits);
+            writer.write_bits(static_cast<uint64_t>(delta_of_delta + limit - 1), bucket.value_bits);
+            return;
+        }
+    }
+    writer.write_bits(0b1111, 4);
+    writer.write_bits(static_cast<uint64_t>(delta_of_delta), 64);
+}
+
+bool TickBlockReader::next(codec::Tick &tick) {
+    if (remaining == 0) return false;
+    if (!read_timestamp(tick.timestamp)) return false;
+    if (!values.next(tick.value) || !inc_rel.next(tick.inc_rel) || !inc_abs.next(tick.inc_abs)) return false;
+    --remaining;
+    ++position;
+    return true;
+}
+
+bool TickBlockReader::read_timestamp(int64_t &timestamp) {
+    uint64_t bits;
+    if (position == 0) {
+        if (!reader.read_bits(bits, 64)) return false;
+        timestamp = previous_timestamp = static_cast<int64_t>(bits);
+        return true;
+    }
+    int64_t delta_of_delta = 0;
+    int prefix_bits = 0;
+    bool bit = true;
+    while (prefix_bits < 4 && bit) {
+        if (!reader.read_bit(bit)) return false;
+        if (bit) ++prefix_bits;
+    }
+    if (prefix_bits == 4) {
+        if (!reader.read_bits(bits, 64)) return false;
+        delta_of_delta = static_cast<int64_t>(bits);
+    } else if (prefix_bits > 0) {
+        auto &&bucket = delta_buckets[prefix_bits - 1];
+        auto &&limit = int64_t(1) << (bucket.value_bits - 1);
+        if (!reader.read_bits(bits, bucket.value_bits)) return false;
+        delta_of_delta = static_cast<int64_t>(bits) - limit + 1;
+    }
+    previous_delta += delta_of_delta;
+    previous_timestamp += previous_delta;
+    timestamp = previous_timestamp;
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef ECHOSERVER_TICK_BLOCK_H
+#define ECHOSERVER_TICK_BLOCK_H
+
+#include <string>
+#include <string_view>
+
+#include "codec/bit_stream.h"
+#include "codec/xor_codec.h"
+#include "codec/series_codec.h"
+
+#define BLOCK_WINDOW_SECONDS 3600
+
+class TickBlockWriter {
+public:
+    explicit TickBlockWriter(std::string &out) :
+            writer(out), values(writer), inc_rel(writer), inc_abs(writer),
+            previous_timestamp(0), previous_delta(0), count(0) {}
+
+    void add(const codec::Tick &tick);
+
+    void finish();
+
+    uint32_t size() const {
+        return count;
+    }
+
+private:
+    void write_timestamp(int64_t timestamp);
+
+    codec::BitWriter writer;
+    codec::XorEncoder values;
+    codec::XorEncoder inc_rel;
+    codec::XorEncoder inc_abs;
+    int64_t previous_timestamp;
+    int64_t previous_delta;
+    uint32_t count;
+};
+
+class TickBlockReader {
+public:
+    TickBlockReader(std::string_view data, uint32_t count) :
+            reader(data), values(reader), inc_rel(reader), inc_abs(reader),
+            previous_timestamp(0), previous_delta(0), remaining(count), position(0) {}
+
+    bool next(codec::Tick &tick);
+
+private:
+    bool read_timestamp(int64_t &timestamp);
+
+    codec::BitReader reader;
+    codec::XorDecoder values;
+    codec::XorDecoder inc_rel;
+    codec::XorDecoder inc_abs;
+    int64_t previous_timestamp;
+    int64_t previous_delta;
+    uint32_t remaining;
+    uint32_t position;
+};
+
+#endif
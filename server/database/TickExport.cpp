@@ -0,0 +1,179 @@
+#include "TickExport.h"
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#include "TickImport.h"
+#include "codec/binary_io.h"
+#include "logging/logger.h"
+
+namespace {
+    template<typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+        // Blocks while the queue is full, returns false once it is closed.
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [&] { return items.size() < capacity || closed; });
+            if (closed) return false;
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+            return true;
+        }
+
+        // Blocks while the queue is empty, returns false once it is closed and drained.
+        bool pop(T &item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [&] { return !items.empty() || closed; });
+            if (items.empty()) return false;
+            item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            not_empty.notify_all();
+            not_full.notify_all();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed;
+    };
+
+    // mktime is slow, so the start of the last seen hour is kept like in the importer.
+    class TimestampCache {
+    public:
+        int64_t timestamp(const std::tm &date) {
+            if (date.tm_year != hour.tm_year || date.tm_mon != hour.tm_mon || date.tm_mday != hour.tm_mday ||
+                date.tm_hour != hour.tm_hour || hour_start < 0) {
+                hour = date;
+                hour.tm_min = 0;
+                hour.tm_sec = 0;
+                hour_start = date_to_timestamp(hour);
+            }
+            return hour_start + date.tm_min * 60 + date.tm_sec;
+        }
+
+    private:
+        std::tm hour{};
+        int64_t hour_start = -1;
+    };
+
+    // to_chars prints the shortest text that reads back as the same double.
+    void encode_csv(const std::vector<FinanceUnit> &units, TimestampCache &cache, std::string &out) {
+        char number[64];
+        for (auto &&unit: units) {
+            out.append(unit.currency);
+            out.push_back(',');
+            auto &&timestamp_end = std::to_chars(number, number + sizeof(number), cache.timestamp(unit.date)).ptr;
+            out.append(number, timestamp_end);
+            out.push_back(',');
+            auto &&value_end = std::to_chars(number, number + sizeof(number), unit.value).ptr;
+            out.append(number, value_end);
+            out.push_back('\n');
+        }
+    }
+
+    void encode_binary(const std::vector<FinanceUnit> &units, TimestampCache &cache, std::string &out) {
+        for (auto &&unit: units) {
+            ImportRecord record{};
+            std::memcpy(record.currency, unit.currency.data(),
+                        unit.currency.size() < IMPORT_CURRENCY_SIZE ? unit.currency.size() : IMPORT_CURRENCY_SIZE);
+            record.timestamp = cache.timestamp(unit.date);
+            record.value = unit.value;
+            codec::write_pod(out, record);
+        }
+    }
+}
+
+bool export_format_supported(const std::string &format) {
+    return format == EXPORT_FORMAT_CSV || format == EXPORT_FORMAT_BINARY;
+}
+
+int export_ticks(FinanceStorage &storage, const std::vector<std::string> &currencies, const std::string &format,
+                 const std::string &output_path, ExportStats &stats) {
+    if (!export_format_supported(format)) return -1;
+    auto &&start = std::chrono::steady_clock::now();
+    auto &&temporary_path = output_path + ".tmp";
+    auto output = std::fopen(temporary_path.c_str(), "wb");
+    if (output == nullptr) {
+        Logger::logger_inst->error("Cannot create {}", temporary_path);
+        return -1;
+    }
+    auto &&binary = format == EXPORT_FORMAT_BINARY;
+    BoundedQueue<std::vector<FinanceUnit>> batches(EXPORT_QUEUE_BATCHES);
+    BoundedQueue<std::string> chunks(EXPORT_QUEUE_BATCHES);
+    std::atomic_bool write_failed(false);
+
+    std::thread encoder([&] {
+        TimestampCache cache;
+        std::string header;
+        if (binary) {
+            codec::write_pod(header, static_cast<uint32_t>(IMPORT_MAGIC));
+            codec::write_pod(header, static_cast<uint32_t>(IMPORT_VERSION));
+            chunks.push(std::move(header));
+        }
+        std::vector<FinanceUnit> batch;
+        while (batches.pop(batch)) {
+            std::string chunk;
+            if (binary) encode_binary(batch, cache, chunk);
+            else encode_csv(batch, cache, chunk);
+            stats.rows += batch.size();
+            if (!chunks.push(std::move(chunk))) break;
+        }
+        chunks.close();
+    });
+    std::thread writer([&] {
+        std::string chunk;
+        while (chunks.pop(chunk)) {
+            if (std::fwrite(chunk.data(), 1, chunk.size(), output) != chunk.size()) {
+                write_failed = true;
+                chunks.close();
+                batches.close();
+                break;
+            }
+            stats.bytes += chunk.size();
+        }
+    });
+
+    auto &&status = storage.export_units(currencies, [&](std::vector<FinanceUnit> &batch) {
+        if (!batches.push(std::move(batch))) return false;
+        batch.clear();
+        return true;
+    });
+    batches.close();
+    encoder.join();
+    writer.join();
+    auto &&close_status = std::fclose(output);
+    if (status != 0 || write_failed || close_status != 0) {
+        Logger::logger_inst->error("Export to {} failed", output_path);
+        std::remove(temporary_path.c_str());
+        return status != 0 ? status : -1;
+    }
+    try {
+        std::filesystem::rename(temporary_path, output_path);
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("Cannot rename {}: {}", temporary_path, ex.what());
+        return -1;
+    }
+    stats.ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef ECHOSERVER_TICK_EXPORT_H
+#define ECHOSERVER_TICK_EXPORT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FinanceStorage.h"
+
+#define EXPORT_FORMAT_CSV "csv"
+#define EXPORT_FORMAT_BINARY "binary"
+#define EXPORT_QUEUE_BATCHES 8
+
+struct ExportStats {
+    size_t rows = 0;
+    size_t bytes = 0;
+    int64_t ms = 0;
+};
+
+bool export_format_supported(const std::string &format);
+
+// Writes the rows of the given currencies, or of all of them, to output_path in the CSV or
+// binary tick format that db_init import reads. Reading from the storage, encoding and
+// writing run on their own threads joined by queues of at most EXPORT_QUEUE_BATCHES
+// batches, so memory stays bounded whatever the size of the export. The file is written
+// next to output_path and renamed over it once complete. The binary format keeps the
+// first IMPORT_CURRENCY_SIZE bytes of a currency name.
+int export_ticks(FinanceStorage &storage, const std::vector<std::string> &currencies, const std::string &format,
+                 const std::string &output_path, ExportStats &stats);
+
+
+#endif
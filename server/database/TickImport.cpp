@@ -0,0 +1,323 @@
+#include "TickImport.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include <SQLiteCpp/SQLiteCpp.h>
+
+#include "FinanceDb.h"
+#include "MappedFile.h"
+#include "codec/binary_io.h"
+#include "logging/logger.h"
+
+namespace {
+    struct ParsedTick {
+        std::string_view currency;
+        int64_t timestamp;
+        double value;
+    };
+
+    struct ImportSeries {
+        std::string currency;
+        int64_t currency_id = 0;
+        std::vector<int64_t> timestamps;
+        std::vector<double> values;
+        std::vector<double> inc_abs;
+        std::vector<double> inc_rel;
+        double previous = 0;
+        bool has_previous = false;
+        int64_t newest = INT64_MIN;
+    };
+
+    int64_t elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool parse_line(std::string_view line, ParsedTick &tick) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        auto &&first = line.find(',');
+        if (first == std::string_view::npos || first == 0) return false;
+        auto &&second = line.find(',', first + 1);
+        if (second == std::string_view::npos) return false;
+        tick.currency = line.substr(0, first);
+        auto &&end = line.data() + line.size();
+        auto &&time_result = std::from_chars(line.data() + first + 1, line.data() + second, tick.timestamp);
+        if (time_result.ec != std::errc() || time_result.ptr != line.data() + second) return false;
+        auto &&value_result = std::from_chars(line.data() + second + 1, end, tick.value);
+        return value_result.ec == std::errc() && value_result.ptr == end;
+    }
+
+    void parse_csv(std::string_view data, std::vector<ParsedTick> &ticks, size_t &skipped) {
+        while (!data.empty()) {
+            auto &&line_end = data.find('\n');
+            auto &&line = data.substr(0, line_end);
+            data.remove_prefix(line_end == std::string_view::npos ? data.size() : line_end + 1);
+            if (line.empty() || line == "\r") continue;
+            ParsedTick tick{};
+            if (parse_line(line, tick)) ticks.push_back(tick);
+            else ++skipped;
+        }
+    }
+
+    void parse_records(std::string_view data, std::vector<ParsedTick> &ticks) {
+        ticks.reserve(data.size() / sizeof(ImportRecord));
+        for (size_t offset = 0; offset + sizeof(ImportRecord) <= data.size(); offset += sizeof(ImportRecord)) {
+            ImportRecord record{};
+            std::memcpy(&record, data.data() + offset, sizeof(record));
+            auto &&name = data.data() + offset;
+            ticks.push_back(ParsedTick{std::string_view(name, strnlen(name, IMPORT_CURRENCY_SIZE)),
+                                       record.timestamp, record.value});
+        }
+    }
+
+    // Every part but the first starts after a line break, so no line is cut in two.
+    std::vector<std::string_view> split_lines(std::string_view data, size_t parts) {
+        std::vector<std::string_view> result;
+        size_t begin = 0;
+        for (size_t part = 1; part <= parts && begin < data.size(); ++part) {
+            size_t end = part == parts ? data.size() : data.size() * part / parts;
+            if (end < begin) end = begin;
+            end = data.find('\n', end);
+            end = end == std::string_view::npos ? data.size() : end + 1;
+            result.push_back(data.substr(begin, end - begin));
+            begin = end;
+        }
+        return result;
+    }
+
+    std::vector<std::string_view> split_records(std::string_view data, size_t parts) {
+        std::vector<std::string_view> result;
+        auto &&records = data.size() / sizeof(ImportRecord);
+        for (size_t part = 0; part < parts; ++part) {
+            auto &&first = records * part / parts;
+            auto &&last = records * (part + 1) / parts;
+            result.push_back(data.substr(first * sizeof(ImportRecord), (last - first) * sizeof(ImportRecord)));
+        }
+        return result;
+    }
+
+    void group_series(std::vector<std::vector<ParsedTick>> &parts, std::vector<ImportSeries> &series) {
+        std::unordered_map<std::string_view, size_t> positions;
+        for (auto &&part: parts) {
+            for (auto &&tick: part) {
+                auto &&position = positions.emplace(tick.currency, series.size());
+                if (position.second) series.push_back(ImportSeries{std::string(tick.currency)});
+                auto &&target = series[position.first->second];
+                target.timestamps.push_back(tick.timestamp);
+                target.values.push_back(tick.value);
+            }
+            part = std::vector<ParsedTick>();
+        }
+    }
+
+    void sort_by_time(ImportSeries &series) {
+        if (std::is_sorted(series.timestamps.begin(), series.timestamps.end())) return;
+        std::vector<size_t> order(series.timestamps.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t left, size_t right) {
+            return series.timestamps[left] < series.timestamps[right];
+        });
+        std::vector<int64_t> timestamps(order.size());
+        std::vector<double> values(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            timestamps[i] = series.timestamps[order[i]];
+            values[i] = series.values[order[i]];
+        }
+        series.timestamps.swap(timestamps);
+        series.values.swap(values);
+    }
+
+    // Rows of a currency are read back in id order, so ticks dated before its newest stored
+    // one would come after it and are dropped. Returns how many were.
+    size_t drop_stale(ImportSeries &series) {
+        auto &&first = std::lower_bound(series.timestamps.begin(), series.timestamps.end(), series.newest);
+        auto &&stale = static_cast<size_t>(first - series.timestamps.begin());
+        series.timestamps.erase(series.timestamps.begin(), first);
+        series.values.erase(series.values.begin(), series.values.begin() + stale);
+        return stale;
+    }
+
+    // The loop has no dependency between iterations, so the compiler vectorizes it.
+    void compute_increments(ImportSeries &series) {
+        auto &&count = series.values.size();
+        series.inc_abs.resize(count);
+        series.inc_rel.resize(count);
+        if (count == 0) return;
+        auto values = series.values.data();
+        auto inc_abs = series.inc_abs.data();
+        auto inc_rel = series.inc_rel.data();
+        for (size_t i = 1; i < count; ++i) {
+            inc_abs[i] = values[i] - values[i - 1];
+            inc_rel[i] = inc_abs[i] / values[i - 1];
+        }
+        inc_abs[0] = series.has_previous ? values[0] - series.previous : 0;
+        inc_rel[0] = series.has_previous ? inc_abs[0] / series.previous : 0;
+    }
+
+    // Formatting a date is the costliest part of a row, so the part up to the hour is
+    // reused while the ticks stay within the same hour.
+    class DateFormatter {
+    public:
+        const std::string &format(int64_t timestamp) {
+            if (timestamp < hour_start || timestamp >= hour_start + 3600) {
+                auto &&date = timestamp_to_date(timestamp);
+                hour_start = timestamp - date.tm_min * 60 - date.tm_sec;
+                auto &&formatted = format_date(date);
+                prefix = formatted.substr(0, formatted.size() - 5);
+            }
+            auto &&offset = timestamp - hour_start;
+            auto &&minutes = static_cast<int>(offset / 60);
+            auto &&seconds = static_cast<int>(offset % 60);
+            text = prefix;
+            text.push_back(static_cast<char>('0' + minutes / 10));
+            text.push_back(static_cast<char>('0' + minutes % 10));
+            text.push_back(':');
+            text.push_back(static_cast<char>('0' + seconds / 10));
+            text.push_back(static_cast<char>('0' + seconds % 10));
+            return text;
+        }
+
+    private:
+        int64_t hour_start = INT64_MIN / 2;
+        std::string prefix;
+        std::string text;
+    };
+
+    // Gives new currencies their ids and reads the latest value and time of the known ones.
+    // Blocks are checked too, since a database written by an older import can hold sealed
+    // ticks newer than its latest row.
+    void load_previous(SQLite::Database &db, std::vector<ImportSeries> &series) {
+        SQLite::Statement add_code(db, "INSERT OR IGNORE INTO currencies (code) VALUES (?)");
+        SQLite::Statement find_code(db, "SELECT id FROM currencies WHERE code = ?");
+        SQLite::Statement latest(db, "SELECT value, date FROM finance WHERE currency_id = ?"
+                " ORDER BY id DESC LIMIT 1");
+        SQLite::Statement sealed(db, "SELECT MAX(end_time) FROM finance_blocks WHERE currency_id = ?");
+        SQLite::Transaction transaction(db);
+        for (auto &&target: series) {
+            add_code.bind(1, target.currency);
+            add_code.exec();
+            add_code.reset();
+            find_code.bind(1, target.currency);
+            if (find_code.executeStep()) target.currency_id = find_code.getColumn(0).getInt64();
+            find_code.reset();
+            latest.bind(1, target.currency_id);
+            if (latest.executeStep() && !latest.getColumn(0).isNull()) {
+                target.previous = latest.getColumn(0).getDouble();
+                target.has_previous = true;
+                target.newest = date_to_timestamp(parse_date(latest.getColumn(1).getString()));
+            }
+            latest.reset();
+            sealed.bind(1, target.currency_id);
+            if (sealed.executeStep() && !sealed.getColumn(0).isNull()) {
+                target.newest = std::max(target.newest, sealed.getColumn(0).getInt64());
+            }
+            sealed.reset();
+        }
+        transaction.commit();
+    }
+
+    void insert_series(SQLite::Database &db, std::vector<ImportSeries> &series) {
+        SQLite::Statement remove_placeholder(db, "DELETE FROM finance WHERE currency_id = ? AND value IS NULL");
+        SQLite::Statement insert(db, "INSERT INTO finance (currency_id, value, inc_rel, inc_abs, date)"
+                " VALUES (?, ?, ?, ?, ?)");
+        DateFormatter formatter;
+        size_t in_transaction = 0;
+        auto transaction = std::make_unique<SQLite::Transaction>(db);
+        for (auto &&target: series) {
+            if (!target.has_previous) {
+                remove_placeholder.bind(1, target.currency_id);
+                remove_placeholder.exec();
+                remove_placeholder.reset();
+            }
+            insert.bind(1, target.currency_id);
+            for (size_t i = 0; i < target.values.size(); ++i) {
+                insert.bind(2, target.values[i]);
+                insert.bind(3, target.inc_rel[i]);
+                insert.bind(4, target.inc_abs[i]);
+                insert.bindNoCopy(5, formatter.format(target.timestamps[i]));
+                insert.exec();
+                insert.reset();
+                if (++in_transaction == IMPORT_TRANSACTION_ROWS) {
+                    transaction->commit();
+                    transaction = std::make_unique<SQLite::Transaction>(db);
+                    in_transaction = 0;
+                }
+            }
+        }
+        transaction->commit();
+    }
+}
+
+int import_ticks(const std::string &db_path, const std::string &input_path, ImportStats &stats, size_t threads) {
+    try {
+        auto &&start = std::chrono::steady_clock::now();
+        MappedFile input;
+        if (!input.open(input_path)) {
+            Logger::logger_inst->error("Cannot open {}", input_path);
+            return -1;
+        }
+        auto &&data = input.data();
+        if (threads == 0) threads = 1;
+        uint32_t magic = 0, version = 0;
+        std::string_view header = data;
+        std::vector<std::string_view> parts;
+        if (codec::read_pod(header, magic) && magic == IMPORT_MAGIC) {
+            if (!codec::read_pod(header, version) || version != IMPORT_VERSION) {
+                Logger::logger_inst->error("Unsupported tick file version {}", version);
+                return -1;
+            }
+            parts = split_records(header, threads);
+        } else {
+            parts = split_lines(data, threads);
+        }
+        auto &&binary = magic == IMPORT_MAGIC;
+        std::vector<std::vector<ParsedTick>> parsed(parts.size());
+        std::vector<size_t> skipped(parts.size(), 0);
+        std::vector<std::thread> parsers;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            parsers.emplace_back([&, i] {
+                if (binary) parse_records(parts[i], parsed[i]);
+                else parse_csv(parts[i], parsed[i], skipped[i]);
+            });
+        }
+        for (auto &&parser: parsers) {
+            parser.join();
+        }
+        std::vector<ImportSeries> series;
+        group_series(parsed, series);
+
+        SQLite::Database db(db_path, SQLite::OPEN_READWRITE);
+        FinanceDb::upgrade_schema(db);
+        load_previous(db, series);
+        for (auto &&target: series) {
+            sort_by_time(target);
+            stats.stale += drop_stale(target);
+            compute_increments(target);
+            stats.rows += target.values.size();
+        }
+        stats.currencies = series.size();
+        stats.skipped = std::accumulate(skipped.begin(), skipped.end(), size_t(0));
+        stats.parse_ms = elapsed_ms(start);
+
+        auto &&insert_start = std::chrono::steady_clock::now();
+        db.exec("PRAGMA synchronous = OFF");
+        db.exec("DROP INDEX IF EXISTS " FINANCE_CURRENCY_INDEX);
+        insert_series(db, series);
+        stats.insert_ms = elapsed_ms(insert_start);
+
+        auto &&index_start = std::chrono::steady_clock::now();
+        db.exec(FINANCE_CURRENCY_INDEX_SQL);
+        // The saved quotes do not know about the new rows, the next start rebuilds them.
+        db.exec("UPDATE finance_state SET generation = generation + 1 WHERE id = 0");
+        stats.index_ms = elapsed_ms(index_start);
+    } catch (std::exception &ex) {
+        Logger::logger_inst->error("Import exception: {}", ex.what());
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef ECHOSERVER_TICK_IMPORT_H
+#define ECHOSERVER_TICK_IMPORT_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#define IMPORT_MAGIC 0x4b434954u
+#define IMPORT_VERSION 1
+#define IMPORT_CURRENCY_SIZE 16
+#define IMPORT_TRANSACTION_ROWS 500000
+
+// A binary tick file is a u32 magic and a u32 version followed by these records. The
+// currency is padded with zero bytes.
+struct ImportRecord {
+    char currency[IMPORT_CURRENCY_SIZE];
+    int64_t timestamp;
+    double value;
+};
+
+struct ImportStats {
+    size_t rows = 0;
+    size_t currencies = 0;
+    size_t skipped = 0;
+    size_t stale = 0;
+    int64_t parse_ms = 0;
+    int64_t insert_ms = 0;
+    int64_t index_ms = 0;
+};
+
+// Appends ticks to the finance table of the database at db_path. The input is either a
+// binary tick file or CSV with "currency,unix_time,value" lines; lines that do not parse,
+// such as a header, are skipped. Ticks of a currency are stored in time order after the
+// rows it already has, and their increments continue from its latest stored value. Ticks
+// dated before the newest one a currency already has are dropped and counted as stale.
+// The file is mapped and parsed by several threads while the rows go through one prepared
+// statement in large transactions, with the currency index rebuilt after the load.
+int import_ticks(const std::string &db_path, const std::string &input_path, ImportStats &stats,
+                 size_t threads = std::thread::hardware_concurrency());
+
+
+#endif
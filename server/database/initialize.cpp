@@ -1,4 +1,68 @@
+#include <iostream>
+#include <string>
 #include "FinanceDb.h"
-int main(){
-    FinanceDb::reset();
-}
\ No newline at end of file
+#include "ShardedStorage.h"
+#include "TickImport.h"
+#include "TickExport.h"
+#include "logging/logger.h"
+
+void usage() {
+    std::cerr << "usage: db_init [shards]\n"
+              << "       db_init import <csv or tick file> [db]\n"
+              << "       db_init export <csv|binary> <file> [db [currency...]]" << std::endl;
+}
+
+int import(const std::string &input_path, const std::string &db_path) {
+    ImportStats stats;
+    if (import_ticks(db_path, input_path, stats) != 0) return 1;
+    auto &&total_ms = stats.parse_ms + stats.insert_ms + stats.index_ms;
+    auto &&rows_per_second = total_ms > 0 ? static_cast<int64_t>(stats.rows) * 1000 / total_ms
+                                          : static_cast<int64_t>(stats.rows);
+    Logger::logger_inst->info("Imported {} rows of {} currencies in {} ms ({} rows/s), skipped {} lines"
+                              " and {} stale ticks", stats.rows, stats.currencies, total_ms, rows_per_second,
+                              stats.skipped, stats.stale);
+    Logger::logger_inst->info("Parse {} ms, insert {} ms, index {} ms",
+                              stats.parse_ms, stats.insert_ms, stats.index_ms);
+    return 0;
+}
+
+int export_data(const std::string &format, const std::string &output_path, const std::string &db_path,
+                const std::vector<std::string> &currencies) {
+    if (!export_format_supported(format)) {
+        usage();
+        return 1;
+    }
+    FinanceDb database(db_path);
+    ExportStats stats;
+    if (export_ticks(database, currencies, format, output_path, stats) != 0) return 1;
+    auto &&rows_per_second = stats.ms > 0 ? static_cast<int64_t>(stats.rows) * 1000 / stats.ms
+                                          : static_cast<int64_t>(stats.rows);
+    Logger::logger_inst->info("Exported {} rows, {} bytes in {} ms ({} rows/s)",
+                              stats.rows, stats.bytes, stats.ms, rows_per_second);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int status = 0;
+    if (argc > 1 && std::string(argv[1]) == "import") {
+        if (argc < 3) {
+            usage();
+            return 1;
+        }
+        status = import(argv[2], argc > 3 ? argv[3] : FINANCE_DB_PATH);
+    } else if (argc > 1 && std::string(argv[1]) == "export") {
+        if (argc < 4) {
+            usage();
+            return 1;
+        }
+        std::vector<std::string> currencies(argv + (argc > 5 ? 5 : argc), argv + argc);
+        status = export_data(argv[2], argv[3], argc > 4 ? argv[4] : FINANCE_DB_PATH, currencies);
+    } else {
+        FinanceDb::reset();
+        if (argc > 1) {
+            ShardedStorage::reset(FINANCE_DB_PATH, std::stoul(argv[1]));
+        }
+    }
+    Logger::logger_inst->flush();
+    return status;
+}
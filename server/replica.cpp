@@ -0,0 +1,168 @@
+#include "replica.h"
+#include <chrono>
+#include <set>
+#include <sstream>
+#include "logging/logger.h"
+#include "json/src/json.hpp"
+
+namespace {
+    int64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    nlohmann::json response_json(const client::Response &response) {
+        if (response.prefix != JSON_PREFIX) throw std::runtime_error("Primary replied " + response.body);
+        return nlohmann::json::parse(response.body);
+    }
+}
+
+server::Replica::Replica(FinanceStorage &storage, const std::string &host, uint16_t port) :
+        storage(storage), primary_name(host + ":" + std::to_string(port)), primary(host, port, 1),
+        copied_until(0), epoch(0), copied(false), applied(0), head(0), applied_time(0), terminate(false) {}
+
+server::Replica::~Replica() {
+    stop();
+}
+
+void server::Replica::start() {
+    terminate = false;
+    worker = std::thread(&Replica::run, this);
+}
+
+void server::Replica::stop() {
+    terminate = true;
+    if (worker.joinable()) worker.join();
+}
+
+std::string server::Replica::status() {
+    uint64_t applied_sequence = applied;
+    uint64_t head_sequence = head;
+    auto &&behind = head_sequence > applied_sequence ? head_sequence - applied_sequence : 0;
+    auto &&lag_ms = behind > 0 ? now_ms() - applied_time : 0;
+    std::stringstream out_string;
+    out_string << "Replica of " << primary_name << (copied ? "" : " (copying)")
+               << ": applied " << applied_sequence << " of " << head_sequence
+               << ", lag " << behind << " changes, " << lag_ms << " ms";
+    return out_string.str();
+}
+
+void server::Replica::run() {
+    auto &&next_report = std::chrono::steady_clock::now();
+    while (!terminate) {
+        bool pending;
+        try {
+            if (!copied) {
+                copy();
+                continue;
+            }
+            pending = follow();
+        } catch (std::exception &ex) {
+            Logger::logger_inst->error("Replication from {} failed: {}", primary_name, ex.what());
+            std::this_thread::sleep_for(std::chrono::milliseconds(REPLICA_RETRY_MS));
+            continue;
+        }
+        auto &&now = std::chrono::steady_clock::now();
+        if (now >= next_report) {
+            Logger::logger_inst->info(status());
+            next_report = now + std::chrono::seconds(REPLICA_REPORT_SECONDS);
+        }
+        if (!pending) std::this_thread::sleep_for(std::chrono::milliseconds(REPLICA_POLL_MS));
+    }
+}
+
+void server::Replica::clear() {
+    std::vector<FinanceUnit> units;
+    if (storage.currency_list(units) != 0) throw std::runtime_error("Cannot list local currencies");
+    std::set<std::string> names;
+    for (auto &&unit: units) {
+        names.insert(unit.currency);
+    }
+    for (auto name: names) {
+        if (storage.del_currency(name) < 0) throw std::runtime_error("Cannot delete local currency " + name);
+    }
+}
+
+// Changes after the sequence of the listing are followed from the log, so a currency
+// created or deleted while copying ends up in the same state as on the primary.
+void server::Replica::copy() {
+    auto &&start = std::chrono::steady_clock::now();
+    clear();
+    copied_at.clear();
+    auto &&listing = response_json(primary.snapshot().get());
+    epoch = listing.at("epoch").get<uint64_t>();
+    applied = listing.at("sequence").get<uint64_t>();
+    copied_until = applied;
+    auto &&currencies = listing.at("currencies");
+    for (auto &&currency: currencies) {
+        if (terminate) return;
+        copy_currency(currency.get<std::string>());
+    }
+    copied = true;
+    auto &&elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    Logger::logger_inst->info("Copied {} currencies from {} in {} ms", currencies.size(), primary_name, elapsed);
+}
+
+// A currency without values comes back with an empty history.
+void server::Replica::copy_currency(const std::string &currency) {
+    auto &&response = primary.snapshot(currency).get();
+    if (response.is_error()) {
+        LOG_DEBUG("Currency {} is gone from {}: {}", currency, primary_name, response.body);
+        return;
+    }
+    auto &&snapshot = response_json(response);
+    auto &&sequence = snapshot.at("sequence").get<uint64_t>();
+    copied_at[currency] = sequence;
+    if (sequence > copied_until) copied_until = sequence;
+    auto &&history = snapshot.at("history");
+    std::string name(currency);
+    if (history.empty()) {
+        if (storage.add_currency(name) < 0) throw std::runtime_error("Cannot add local currency " + name);
+        return;
+    }
+    for (auto &&item: history) {
+        FinanceUnit unit{name, item.at(0).get<double>(), item.at(1).get<double>(), item.at(2).get<double>(),
+                         timestamp_to_date(item.at(3).get<int64_t>())};
+        if (storage.insert(unit) != 0) throw std::runtime_error("Cannot insert into local currency " + name);
+    }
+}
+
+// Returns true when the primary has more changes ready.
+bool server::Replica::follow() {
+    protocol::ChangeBatch batch;
+    auto &&response = primary.changes(applied).get();
+    if (response.prefix != JSON_PREFIX || !protocol::parse_changes(response.body, batch)) {
+        throw std::runtime_error("Primary replied " + response.body);
+    }
+    head = batch.head;
+    if (batch.epoch != epoch || batch.truncated || batch.head < applied) {
+        Logger::logger_inst->warn("Change log of {} no longer follows this replica, copying again", primary_name);
+        copied = false;
+        return true;
+    }
+    for (auto &&change: batch.changes) {
+        if (change.sequence <= applied) continue;
+        apply(change);
+        applied = change.sequence;
+        applied_time = change.time;
+    }
+    if (!copied_at.empty() && applied >= copied_until) copied_at.clear();
+    return applied < batch.head;
+}
+
+void server::Replica::apply(const protocol::Change &change) {
+    auto &&copy = copied_at.find(change.currency);
+    if (copy != copied_at.end() && change.sequence <= copy->second) return;
+    std::string currency(change.currency);
+    int status = 0;
+    if (change.op == CHANGE_ADD_CURRENCY) {
+        status = storage.add_currency(currency);
+    } else if (change.op == CHANGE_ADD_CURRENCY_VALUE) {
+        FinanceUnit unit{currency, change.value, change.inc_rel, change.inc_abs, timestamp_to_date(change.date)};
+        status = storage.insert(unit);
+    } else if (change.op == CHANGE_DEL_CURRENCY) {
+        status = storage.del_currency(currency);
+    }
+    if (status < 0) throw std::runtime_error("Cannot apply change " + std::to_string(change.sequence));
+}
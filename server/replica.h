@@ -0,0 +1,70 @@
+#ifndef ECHOSERVER_REPLICA_H
+#define ECHOSERVER_REPLICA_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "database/FinanceStorage.h"
+#include "protocol/changes.h"
+#include "lib/FinanceClient.h"
+
+#define REPLICA_POLL_MS 100
+#define REPLICA_RETRY_MS 1000
+#define REPLICA_REPORT_SECONDS 10
+
+namespace server {
+
+    // Follows the change log of a primary server and applies it to the local storage.
+    // The replica starts by copying every currency, each one at the change log sequence
+    // the primary read it at, and then skips the changes the copy already holds. Values
+    // from the log are stored as the rows the primary stored, with its increments and
+    // dates, and a change at or below the last applied one is never applied twice. The
+    // local storage is expected to start empty; it is cleared again when the primary
+    // restarts or its log no longer reaches back to the last applied change.
+    class Replica {
+    public:
+        Replica(FinanceStorage &storage, const std::string &host, uint16_t port);
+
+        ~Replica();
+
+        Replica(const Replica &) = delete;
+
+        Replica &operator=(const Replica &) = delete;
+
+        void start();
+
+        void stop();
+
+        std::string status();
+
+    private:
+        void run();
+
+        void clear();
+
+        void copy();
+
+        void copy_currency(const std::string &currency);
+
+        bool follow();
+
+        void apply(const protocol::Change &change);
+
+        FinanceStorage &storage;
+        std::string primary_name;
+        client::FinanceClient primary;
+        std::unordered_map<std::string, uint64_t> copied_at;
+        uint64_t copied_until;
+        uint64_t epoch;
+        std::atomic_bool copied;
+        std::atomic<uint64_t> applied;
+        std::atomic<uint64_t> head;
+        std::atomic<int64_t> applied_time;
+        std::atomic_bool terminate;
+        std::thread worker;
+    };
+}
+
+#endif
@@ -1,8 +1,16 @@
+#include <cctype>
+#include <filesystem>
+#include <random>
+#include <set>
 #include <sstream>
 #include <WS2tcpip.h>
 #include "server.h"
+#include "database/TickExport.h"
 #include "logging/logger.h"
-#include "json/src/json.hpp"
+#include "protocol/chunking.h"
+#include "protocol/request.h"
+#include "protocol/changes.h"
+#include "protocol/json_writer.h"
 
 
 void server::Server::create_server_socket() {
@@ -27,7 +35,7 @@ void server::Server::create_server_socket() {
     sockaddr_in server{};
     server.sin_family = AF_INET;
     server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(SERVER_PORT);
+    server.sin_port = htons(port);
 
     auto bind_status = bind(server_d, (sockaddr *) &server, sizeof(sockaddr_in));
     if (bind_status == SOCKET_ERROR) {
@@ -40,207 +48,455 @@ void server::Server::create_server_socket() {
         Logger::logger_inst->error("Error in setting socket nonblock {}", WSAGetLastError());
         std::exit(EXIT_FAILURE);
     }
+    enable_offload(server_d);
     server_socket = server_d;
     Logger::logger_inst->info("Server initialized");
 }
 
+// USO and URO are the Windows counterparts of UDP_SEGMENT and UDP_GRO; both need a
+// recent SDK to build and a recent Windows to run, otherwise plain sendto/recvfrom are used.
+void server::Server::enable_offload(SOCKET server_d) {
+#ifdef UDP_SEND_MSG_SIZE
+    DWORD max_segment = 0;
+    int option_size = sizeof(max_segment);
+    auto &&uso_status = getsockopt(server_d, IPPROTO_UDP, UDP_SEND_MSG_SIZE, (char *) &max_segment, &option_size);
+    segmentation_offload = uso_status != SOCKET_ERROR;
+#endif
+#ifdef UDP_RECV_MAX_COALESCED_SIZE
+    GUID recvmsg_id = WSAID_WSARECVMSG;
+    DWORD bytes = 0;
+    auto &&ioctl_status = WSAIoctl(server_d, SIO_GET_EXTENSION_FUNCTION_POINTER, &recvmsg_id, sizeof(recvmsg_id),
+                                   &receive_message, sizeof(receive_message), &bytes, nullptr, nullptr);
+    DWORD coalesced_size = MESSAGE_SIZE;
+    auto &&uro_status = setsockopt(server_d, IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE,
+                                   (char *) &coalesced_size, sizeof(coalesced_size));
+    receive_coalescing = ioctl_status != SOCKET_ERROR && uro_status != SOCKET_ERROR;
+#endif
+    Logger::logger_inst->info("Send segmentation {}, receive coalescing {}",
+                              segmentation_offload ? "on" : "off", receive_coalescing ? "on" : "off");
+}
+
+void server::Server::create_cookie_key() {
+    std::random_device random;
+    cookie_key.k0 = static_cast<uint64_t>(random()) << 32 | random();
+    cookie_key.k1 = static_cast<uint64_t>(random()) << 32 | random();
+}
+
 void server::Server::close_client(int64_t client_d) {
     lock_clients();
-    if (clients.find(client_d) == clients.end())
+    auto &&slot = sessions.find(client_d);
+    if (slot == SESSION_NONE) {
+        unlock_clients();
         return;
-    auto &&client = clients[client_d];
-    clients.erase(client_d);
+    }
+    sessions.close(slot);
     unlock_clients();
     Logger::logger_inst->info("Client {} disconnected", client_d);
 }
 
 
-void server::Server::process_client_message(std::string &message, int64_t client_id) {
-    Logger::logger_inst->info(message);
+void server::Server::process_client_message(std::string &message, int64_t client_id, uint16_t sequence) {
+    LOG_DEBUG("Message from client {}: {}", client_id, message);
+    if (!first_request_served.exchange(true)) {
+        auto &&elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - launched_at).count();
+        Logger::logger_inst->info("First request {} ms after launch", elapsed);
+    }
     std::string_view message_view(message);
     if (message_view.compare(0, MESSAGE_PREFIX_LEN, CMD_PREFIX) == 0) {
         message_view.remove_prefix(MESSAGE_PREFIX_LEN);
-        process_client_command(message_view, client_id);
+        process_client_command(message_view, client_id, sequence);
     } else if (message_view.compare(0, MESSAGE_PREFIX_LEN, TXT_PREFIX) == 0) {
         message_view.remove_prefix(MESSAGE_PREFIX_LEN);
-        process_client_text(message_view, client_id);
+        process_client_text(message_view, client_id, sequence);
     } else if (message_view.compare(0, MESSAGE_PREFIX_LEN, JSON_PREFIX) == 0) {
         message_view.remove_prefix(MESSAGE_PREFIX_LEN);
-        process_client_json(message_view, client_id);
+        process_client_json(message_view, client_id, sequence);
     } else {
         Logger::logger_inst->error("Client {} Unknown message type: {}", client_id, message);
         auto &&err_message = ERROR_PREFIX + std::string("Unknown message type") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     }
 }
 
 
-void server::Server::process_client_text(std::string_view text, int64_t client_id) {
-    Logger::logger_inst->info("Text from client {}: {}", client_id, text.data());
+void server::Server::process_client_text(std::string_view text, int64_t client_id, uint16_t sequence) {
+    LOG_DEBUG("Text from client {}: {}", client_id, text.data());
     auto &&to_send = std::string(text) + MESSAGE_END;
-    send_message(client_id, to_send);
+    send_message(client_id, sequence, to_send);
 }
 
 
-void server::Server::process_add_currency(std::string &currency, int64_t client_id) {
-    Logger::logger_inst->info("Client {} add currency {}", client_id, currency);
-    auto &&status = database.add_currency(currency);
+void server::Server::process_add_currency(std::string &currency, int64_t client_id, uint16_t sequence) {
+    LOG_SAMPLED("Client {} add currency {}", client_id, currency);
+    auto &&status = storage->add_currency(currency);
     if (status == 0) {
         auto &&response = TXT_PREFIX + std::string("Successfully add currency ") + currency + MESSAGE_END;
-        send_message(client_id, response);
+        send_message(client_id, sequence, response);
     } else if (status == 1) {
         auto &&err_message = ERROR_PREFIX + std::string("Currency already exists: ") + currency + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     } else {
         auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     }
 }
 
-void server::Server::process_add_currency_value(std::string &currency, double value, int64_t client_id) {
-    Logger::logger_inst->info("Client {} add currency {} value {}", client_id, currency, value);
-    auto &&status = database.add_currency_value(currency, value);
+void server::Server::process_add_currency_value(std::string &currency, double value, int64_t client_id,
+                                                uint16_t sequence) {
+    LOG_SAMPLED("Client {} add currency {} value {}", client_id, currency, value);
+    auto &&status = storage->add_currency_value(currency, value);
     if (status == 0) {
         auto &&response = TXT_PREFIX + std::string("Successfully add value for currency ") + currency + MESSAGE_END;
-        send_message(client_id, response);
+        send_message(client_id, sequence, response);
     } else if (status == 1) {
         auto &&err_message = ERROR_PREFIX + std::string("No such currency ") + currency + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     } else {
         auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     }
 }
 
-void server::Server::process_del_currency(std::string &currency, int64_t client_id) {
-    Logger::logger_inst->info("Client {} del currency {}", client_id, currency);
-    auto &&status = database.del_currency(currency);
+void server::Server::process_del_currency(std::string &currency, int64_t client_id, uint16_t sequence) {
+    LOG_SAMPLED("Client {} del currency {}", client_id, currency);
+    auto &&status = storage->del_currency(currency);
     if (status == 0) {
         auto &&response = TXT_PREFIX + std::string("Successfully del currency ") + currency + MESSAGE_END;
-        send_message(client_id, response);
+        send_message(client_id, sequence, response);
     } else if (status == 1) {
         auto &&err_message = ERROR_PREFIX + std::string("No such currency ") + currency + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     } else {
         auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     }
 }
 
-void server::Server::process_list_all_currencies(int64_t client_id) {
-    Logger::logger_inst->info("Client {} list all currencies", client_id);
-    nlohmann::json json_response;
-    auto &&status = database.currency_list(json_response);
+void server::Server::process_list_all_currencies(int64_t client_id, uint16_t sequence, bool compact) {
+    LOG_SAMPLED("Client {} list all currencies", client_id);
+    if (compact) {
+        std::vector<FinanceUnit> units;
+        auto &&status = storage->currency_list(units);
+        if (status == 0) {
+            auto &&response = codec::series_message(units_to_series(units), true);
+            return send_message(client_id, sequence, response);
+        }
+        auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
+        return send_message(client_id, sequence, err_message);
+    }
+    std::string response = JSON_PREFIX;
+    auto &&status = storage->currency_list_json(response);
     if (status == 0) {
-        auto &&response = JSON_PREFIX + json_response.dump() + MESSAGE_END;
-        send_message(client_id, response);
+        response.append(MESSAGE_END);
+        send_message(client_id, sequence, response);
     } else {
         auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     }
 }
 
-void server::Server::process_currency_history(std::string &currency, int64_t client_id) {
-    nlohmann::json json_response;
-    auto &&status = database.currency_history(currency, json_response);
+void server::Server::process_currency_history(std::string &currency, int64_t client_id, uint16_t sequence,
+                                              bool compact) {
+    LOG_SAMPLED("Client {} currency history {}", client_id, currency);
+    std::string response;
+    int status;
+    if (compact) {
+        std::vector<FinanceUnit> units;
+        status = storage->currency_history(currency, units);
+        if (status == 0) response = codec::series_message(units_to_series(units), false);
+    } else {
+        response = JSON_PREFIX;
+        status = storage->currency_history_json(currency, response);
+        if (status == 0) response.append(MESSAGE_END);
+    }
     if (status == 0) {
-        auto &&response = JSON_PREFIX + json_response.dump() + MESSAGE_END;
-        send_message(client_id, response);
+        send_message(client_id, sequence, response);
     } else if (status == 1) {
         auto &&err_message = ERROR_PREFIX + std::string("No such currency ") + currency + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
     } else {
         auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
+    }
+}
+
+void server::Server::process_get_changes(uint64_t since, int64_t client_id, uint16_t sequence) {
+    LOG_SAMPLED("Client {} changes since {}", client_id, since);
+    if (change_log == nullptr) {
+        auto &&err_message = ERROR_PREFIX + std::string("Change log disabled") + MESSAGE_END;
+        return send_message(client_id, sequence, err_message);
+    }
+    protocol::ChangeBatch batch;
+    change_log->changes_since(since, CHANGE_BATCH_LIMIT, batch);
+    send_message(client_id, sequence, protocol::changes_message(batch));
+}
+
+// Without a currency only the names are returned, with the sequence taken before listing them.
+void server::Server::process_snapshot(std::string &currency, int64_t client_id, uint16_t sequence) {
+    LOG_SAMPLED("Client {} snapshot {}", client_id, currency);
+    if (change_log == nullptr) {
+        auto &&err_message = ERROR_PREFIX + std::string("Change log disabled") + MESSAGE_END;
+        return send_message(client_id, sequence, err_message);
+    }
+    std::vector<FinanceUnit> units;
+    std::string response = JSON_PREFIX;
+    protocol::JsonWriter writer(response);
+    int status;
+    writer.begin_object();
+    if (currency.empty()) {
+        auto &&epoch = change_log->epoch();
+        auto &&snapshot_head = change_log->head();
+        status = change_log->currency_list(units);
+        std::set<std::string> names;
+        for (auto &&unit: units) {
+            names.insert(unit.currency);
+        }
+        writer.key("currencies");
+        writer.begin_array();
+        for (auto &&name: names) {
+            writer.value(name);
+        }
+        writer.end_array();
+        writer.key("epoch");
+        writer.value(epoch);
+        writer.key("sequence");
+        writer.value(snapshot_head);
+    } else {
+        uint64_t snapshot_sequence = 0;
+        status = change_log->snapshot(currency, units, snapshot_sequence);
+        writer.key("currency");
+        writer.value(currency);
+        writer.key("history");
+        writer.begin_array();
+        for (auto &&unit: units) {
+            writer.begin_array();
+            writer.value(unit.value);
+            writer.value(unit.inc_rel);
+            writer.value(unit.inc_abs);
+            writer.value(date_to_timestamp(unit.date));
+            writer.end_array();
+        }
+        writer.end_array();
+        writer.key("sequence");
+        writer.value(snapshot_sequence);
+    }
+    writer.end_object();
+    if (status == 0) {
+        response.append(MESSAGE_END);
+        send_message(client_id, sequence, response);
+    } else if (status == 1) {
+        auto &&err_message = ERROR_PREFIX + std::string("No such currency ") + currency + MESSAGE_END;
+        send_message(client_id, sequence, err_message);
+    } else {
+        auto &&err_message = ERROR_PREFIX + std::string("Database error") + MESSAGE_END;
+        send_message(client_id, sequence, err_message);
+    }
+}
+
+namespace {
+    bool valid_export_name(const std::string &name) {
+        if (name.empty() || name[0] == '.') return false;
+        for (auto &&symbol: name) {
+            if (!std::isalnum(static_cast<unsigned char>(symbol)) && symbol != '.' && symbol != '_' && symbol != '-') {
+                return false;
+            }
+        }
+        return true;
     }
 }
 
-void server::Server::process_client_command(std::string_view command, int64_t client_id) {
-    Logger::logger_inst->info("Command from client {}: {}", client_id, command.data());
+// The export runs on a worker and only its start is confirmed; the file shows up under
+// EXPORT_DIR once it is complete.
+void server::Server::process_export(protocol::Request &request, int64_t client_id, uint16_t sequence) {
+    LOG_SAMPLED("Client {} export {}", client_id, request.name);
+    auto &&format = request.format.empty() ? std::string(EXPORT_FORMAT_CSV) : request.format;
+    if (!export_format_supported(format) || !valid_export_name(request.name)) {
+        auto &&err_message = ERROR_PREFIX + std::string("Incorrect export request") + MESSAGE_END;
+        return send_message(client_id, sequence, err_message);
+    }
+    if (export_running.exchange(true)) {
+        auto &&err_message = ERROR_PREFIX + std::string("Export already running") + MESSAGE_END;
+        return send_message(client_id, sequence, err_message);
+    }
+    std::error_code error;
+    std::filesystem::create_directories(EXPORT_DIR, error);
+    auto &&path = (std::filesystem::path(EXPORT_DIR) / request.name).string();
+    workers.enqueue([this, currencies = request.currencies, format, path] {
+        ExportStats stats;
+        if (export_ticks(*storage, currencies, format, path, stats) == 0) {
+            Logger::logger_inst->info("Exported {} rows to {} in {} ms", stats.rows, path, stats.ms);
+        }
+        export_running = false;
+    });
+    auto &&response = TXT_PREFIX + std::string("Exporting to ") + path + MESSAGE_END;
+    send_message(client_id, sequence, response);
+}
+
+void server::Server::process_client_command(std::string_view command, int64_t client_id, uint16_t sequence) {
+    LOG_DEBUG("Command from client {}: {}", client_id, command.data());
     if (command == "disconnect") {
         close_client(client_id);
     } else if (command == REQUEST_GET_ALL_CURRENCIES) {
-        process_list_all_currencies(client_id);
+        process_list_all_currencies(client_id, sequence);
     } else {
         Logger::logger_inst->error("Client {} Unknown command {}", client_id, command.data());
         auto &&err_message = ERROR_PREFIX + std::string("Unknown command") + MESSAGE_END;
-        send_message(client_id, err_message);
-    }
-}
-
-
-void server::Server::process_client_json(std::string_view json_string, int64_t client_id) {
-    Logger::logger_inst->info("Json from client {}: {}", client_id, json_string.data());
-    try {
-        auto &&client_json = nlohmann::json::parse(json_string);
-        std::string request_type = client_json["type"];
-        std::string currency = client_json["currency"];
-        if (request_type == REQUEST_ADD_CURRENCY) {
-            process_add_currency(currency, client_id);
-        } else if (request_type == REQUEST_ADD_CURRENCY_VALUE) {
-            double value = client_json["value"];
-            process_add_currency_value(currency, value, client_id);
-        } else if (request_type == REQUEST_DEL_CURRENCY) {
-            process_del_currency(currency, client_id);
-        } else if (request_type == REQUEST_GET_CURRENCY_HISTORY) {
-            process_currency_history(currency, client_id);
-        } else {
-            Logger::logger_inst->error("Client {} Unknown request type: {}", client_id, request_type);
-            auto &&err_message = ERROR_PREFIX + std::string("Unknown request type") + MESSAGE_END;
-            send_message(client_id, err_message);
-        }
+        send_message(client_id, sequence, err_message);
+    }
+}
 
-    } catch (nlohmann::json::parse_error &ex) {
-        Logger::logger_inst->error("{} client {} json {}", ex.what(), client_id, json_string.data());
+
+void server::Server::process_client_json(std::string_view json_string, int64_t client_id, uint16_t sequence) {
+    LOG_DEBUG("Json from client {}: {}", client_id, json_string.data());
+    protocol::Request request;
+    auto &&parse_status = protocol::parse_request(json_string, request);
+    if (parse_status != 0) {
+        Logger::logger_inst->error("Incorrect json from client {}: {}", client_id, json_string.data());
         auto &&err_message = ERROR_PREFIX + std::string("Incorrect json") + MESSAGE_END;
-        send_message(client_id, err_message);
+        send_message(client_id, sequence, err_message);
         return;
     }
-
+    auto &&compact = request.encoding == ENCODING_COMPACT;
+    auto &&write = request.type == protocol::RequestType::ADD_CURRENCY ||
+                   request.type == protocol::RequestType::ADD_CURRENCY_VALUE ||
+                   request.type == protocol::RequestType::DEL_CURRENCY;
+    if (write && read_only) {
+        auto &&err_message = ERROR_PREFIX + std::string("Read-only replica") + MESSAGE_END;
+        return send_message(client_id, sequence, err_message);
+    }
+    switch (request.type) {
+        case protocol::RequestType::ADD_CURRENCY:
+            return process_add_currency(request.currency, client_id, sequence);
+        case protocol::RequestType::ADD_CURRENCY_VALUE:
+            return process_add_currency_value(request.currency, request.value, client_id, sequence);
+        case protocol::RequestType::DEL_CURRENCY:
+            return process_del_currency(request.currency, client_id, sequence);
+        case protocol::RequestType::GET_CURRENCY_HISTORY:
+            return process_currency_history(request.currency, client_id, sequence, compact);
+        case protocol::RequestType::GET_ALL_CURRENCIES:
+            return process_list_all_currencies(client_id, sequence, compact);
+        case protocol::RequestType::GET_CHANGES:
+            return process_get_changes(request.since, client_id, sequence);
+        case protocol::RequestType::GET_SNAPSHOT:
+            return process_snapshot(request.currency, client_id, sequence);
+        case protocol::RequestType::EXPORT:
+            return process_export(request, client_id, sequence);
+        default:
+            break;
+    }
+    Logger::logger_inst->error("Client {} Unknown request type: {}", client_id, json_string);
+    auto &&err_message = ERROR_PREFIX + std::string("Unknown request type") + MESSAGE_END;
+    send_message(client_id, sequence, err_message);
 }
 
-void server::Server::handle_client_if_possible(int64_t client_id) {
-    std::vector<std::string>* recv_buffer = &clients[client_id].receive_buffer;
-    std::string received_message;
-    for(auto&& chunk : *recv_buffer){
-        received_message += chunk;
-    }
-    auto &&message_end = received_message.find(MESSAGE_END);
+void server::Server::dispatch_message(const std::string &received, int64_t client_id, uint16_t sequence) {
+    auto &&message_end = received.find(MESSAGE_END);
     if (message_end != std::string::npos) {
-        auto &&message = received_message.substr(0, message_end);
-        workers.enqueue(&Server::process_client_message, this, message, client_id);
-    } else{
+        auto &&message = received.substr(0, message_end);
+        workers.enqueue(&Server::process_client_message, this, message, client_id, sequence);
+    } else {
         Logger::logger_inst->error("Incorrect message received from client {}", client_id);
     }
-    recv_buffer->clear();
 }
 
-void server::Server::send_message(int64_t client_id, std::string_view message) {
-    std::vector<std::string>* send_buffer = &clients[client_id].send_buffer;
-    send_buffer->clear();
-    auto size = message.size() / UDP_PACKET_SIZE + 1;
-    for(auto i = 0, j = 0; i < size; i += UDP_PACKET_SIZE, ++j) {
-        auto chunk = message.substr(i, UDP_PACKET_SIZE);
-        char info_str[sizeof(int) * 2 + 1];
-        info_str[0] = CONTENT_MESSAGE;
-        auto packet_info = (int *)(info_str + 1);
-        packet_info[0] = j;
-        packet_info[1] = size;
-        auto packet = std::string(info_str) + std::string(chunk);
-        send_buffer->emplace_back(packet);
+// The message is split outside the lock and the send buffer is only filled under it, so
+// status packets and releases never see a half written or empty buffer. The chunks are sent
+// from the local copy, which an acknowledgement clearing the buffer cannot touch.
+void server::Server::send_message(int64_t client_id, uint16_t sequence, std::string_view message) {
+    sockaddr_in client_addr{};
+    lock_clients();
+    auto slot = sessions.find(client_id);
+    if (slot == SESSION_NONE || sessions.at(slot).sequence != sequence) {
+        unlock_clients();
+        return;
+    }
+    int32_t chunk_size = sessions.at(slot).chunk_size;
+    unlock_clients();
+    std::vector<std::string> packets;
+    protocol::split_message(message, chunk_size, sequence, packets);
+    lock_clients();
+    slot = sessions.find(client_id);
+    if (slot == SESSION_NONE || sessions.at(slot).sequence != sequence) {
+        unlock_clients();
+        return;
+    }
+    session_address(client_id, client_addr);
+    auto &&buffers = sessions.attach_buffers(slot);
+    buffers->send_sequence = sequence;
+    buffers->send_buffer = packets;
+    unlock_clients();
+    send_chunks(client_addr, packets);
+}
+
+// When a segmented send fails offload is turned off and only the packets of that batch
+// and the ones after it are sent again one by one.
+void server::Server::send_chunks(sockaddr_in &client_addr, const std::vector<std::string> &packets) {
+    size_t sent = 0;
+#ifdef UDP_SEND_MSG_SIZE
+    if (segmentation_offload && packets.size() > 1) {
+        std::vector<protocol::SegmentBatch> batches;
+        protocol::segment_batches(packets, batches);
+        for (auto &&batch: batches) {
+            if (!send_segmented(client_addr, batch)) {
+                segmentation_offload = false;
+                break;
+            }
+            sent += batch.count;
+        }
+        if (capture) {
+            auto &&client_id = session_id(client_addr.sin_addr.s_addr, client_addr.sin_port);
+            for (size_t i = 0; i < sent; i++) {
+                capture->record(CAPTURE_OUT, client_id, packets[i]);
+            }
+        }
     }
-    auto client_addr = clients[client_id].ip_addr;
-    for(auto&& packet: *send_buffer) {
-        send_chunk(client_addr, packet);
+#endif
+    for (size_t i = sent; i < packets.size(); i++) {
+        send_chunk(client_addr, packets[i]);
     }
 }
 
+bool server::Server::send_segmented(sockaddr_in &client_addr, const protocol::SegmentBatch &batch) {
+#ifdef UDP_SEND_MSG_SIZE
+    WSABUF buffer{static_cast<ULONG>(batch.data.size()), const_cast<char *>(batch.data.data())};
+    char control[WSA_CMSG_SPACE(sizeof(DWORD))] = {};
+    WSAMSG message{};
+    message.name = reinterpret_cast<LPSOCKADDR>(&client_addr);
+    message.namelen = sizeof(client_addr);
+    message.lpBuffers = &buffer;
+    message.dwBufferCount = 1;
+    message.Control.buf = control;
+    message.Control.len = sizeof(control);
+    auto cmsg = WSA_CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = IPPROTO_UDP;
+    cmsg->cmsg_type = UDP_SEND_MSG_SIZE;
+    cmsg->cmsg_len = WSA_CMSG_LEN(sizeof(DWORD));
+    *reinterpret_cast<DWORD *>(WSA_CMSG_DATA(cmsg)) = static_cast<DWORD>(batch.segment_size);
+    DWORD sent = 0;
+    auto &&send_status = WSASendMsg(server_socket, &message, 0, &sent, nullptr, nullptr);
+    if (send_status == SOCKET_ERROR) {
+        Logger::logger_inst->error("Error in segmented send {}", WSAGetLastError());
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 void server::Server::send_chunk(int64_t client_id, std::string_view message){
-    auto client_addr = clients[client_id].ip_addr;
-    send_chunk(client_addr, message);
+    sockaddr_in client_addr{};
+    lock_clients();
+    auto &&found = session_address(client_id, client_addr);
+    unlock_clients();
+    if (found) send_chunk(client_addr, message);
 }
 
 void server::Server::send_chunk(sockaddr_in& client_addr, std::string_view message){
+    if (capture) {
+        capture->record(CAPTURE_OUT, session_id(client_addr.sin_addr.s_addr, client_addr.sin_port), message);
+    }
     auto addr = reinterpret_cast<sockaddr*>(&client_addr);
     auto &&send_stat = sendto(server_socket, message.data(), message.size(), 0, addr, sizeof(sockaddr));
     if (send_stat == SOCKET_ERROR) {
@@ -248,113 +504,227 @@ void server::Server::send_chunk(sockaddr_in& client_addr, std::string_view messa
     }
 }
 
-void server::Server::client_message_chunk(int64_t client_id, int chunk_number, int total, std::string &message) {
-    std::vector<std::string>* recv_buffer = &clients[client_id].receive_buffer;
-    if(chunk_number == 0){
-        recv_buffer->clear();
-    }
-    auto expected_message = recv_buffer->size();
-    if(chunk_number < expected_message){
+// A request at or before the last one taken from the session has been run already. When
+// the client sends it again the acknowledgement or the reply was lost, so both are sent
+// again from the last chunk of the repeat, the reply only if it is ready.
+void server::Server::client_message_chunk(int64_t client_id, uint16_t sequence, int chunk_number, int total,
+                                          std::string_view chunk) {
+    lock_clients();
+    auto &&slot = sessions.find(client_id);
+    if (slot == SESSION_NONE) {
+        unlock_clients();
         return;
     }
-    if(chunk_number > expected_message){
-        char info_str[sizeof(int) + 1];
-        info_str[0] = CHUNK_REQUEST_MESSAGE;
-        auto packet_info = (int *)(info_str + 1);
-        packet_info[0] = expected_message;
-        auto packet = std::string(info_str);
-        send_chunk(client_id, packet);
+    auto &&session = sessions.at(slot);
+    if (session.sequence != 0 && !protocol::sequence_newer(sequence, session.sequence)) {
+        auto &&repeat = sequence == session.sequence && chunk_number + 1 == total;
+        auto &&buffers = sessions.buffers(slot);
+        std::vector<std::string> reply;
+        if (repeat && buffers != nullptr && buffers->send_sequence == sequence) reply = buffers->send_buffer;
+        sockaddr_in client_addr{};
+        session_address(client_id, client_addr);
+        unlock_clients();
+        if (!repeat) return;
+        send_chunk(client_addr, protocol::status_packet(CHUNK_SUCCESS_MESSAGE, total, sequence));
+        send_chunks(client_addr, reply);
         return;
     }
-    recv_buffer->emplace_back(message);
-    if(chunk_number == total){
-        char info_str[sizeof(int) + 1];
-        info_str[0] = CHUNK_SUCCESS_MESSAGE;
-        auto packet_info = (int *)(info_str + 1);
-        packet_info[0] = total;
-        auto packet = std::string(info_str);
-        send_chunk(client_id, packet);
+    auto &&buffers = sessions.attach_buffers(slot);
+    if (buffers->receive_sequence != sequence) {
+        buffers->receive_buffer.clear();
+        buffers->receive_sequence = sequence;
     }
-    if(recv_buffer->size() == total){
-        handle_client_if_possible(client_id);
+    auto &&status = protocol::add_chunk(buffers->receive_buffer, chunk_number, total, chunk);
+    auto &&expected = static_cast<int32_t>(buffers->receive_buffer.size());
+    std::string received;
+    if (status == protocol::ChunkStatus::COMPLETE) {
+        session.sequence = sequence;
+        received = protocol::join_chunks(buffers->receive_buffer);
+        buffers->receive_buffer.clear();
+    }
+    sessions.release_buffers(slot);
+    unlock_clients();
+    if (status == protocol::ChunkStatus::MISSING) {
+        send_chunk(client_id, protocol::status_packet(CHUNK_REQUEST_MESSAGE, expected, sequence));
+    } else if (status == protocol::ChunkStatus::COMPLETE) {
+        send_chunk(client_id, protocol::status_packet(CHUNK_SUCCESS_MESSAGE, total, sequence));
+        dispatch_message(received, client_id, sequence);
     }
 }
 
-void server::Server::refresh_client_timeout(int64_t client_id) {
-    clients[client_id].timer = 0;
+void server::Server::client_chunk_size(int64_t client_id, int32_t requested) {
+    auto &&chunk_size = protocol::negotiate_chunk_size(requested);
+    lock_clients();
+    auto &&slot = sessions.find(client_id);
+    if (slot != SESSION_NONE) sessions.at(slot).chunk_size = static_cast<uint16_t>(chunk_size);
+    unlock_clients();
+    LOG_DEBUG("Client {} chunk size {}", client_id, chunk_size);
+    send_chunk(client_id, protocol::status_packet(CHUNK_SIZE_MESSAGE, chunk_size));
 }
 
-void server::Server::client_message_status(int64_t client_id, int chunk_number, int status) {
-    std::vector<std::string>* send_buffer = &clients[client_id].send_buffer;
-    if (send_buffer->empty()) return;
-    if(status == CHUNK_SUCCESS_MESSAGE && chunk_number == send_buffer->size()){
-        return send_buffer->clear();
-    }
-    if (status == CHUNK_REQUEST_MESSAGE && chunk_number < send_buffer->size()){
-        return send_chunk(client_id, send_buffer->at(chunk_number));
+bool server::Server::refresh_client_timeout(int64_t client_id) {
+    lock_clients();
+    auto &&slot = sessions.find(client_id);
+    if (slot != SESSION_NONE) sessions.at(slot).idle_ticks = 0;
+    unlock_clients();
+    return slot != SESSION_NONE;
+}
+
+// A requested chunk is copied out under the clients lock and sent after releasing it.
+void server::Server::client_message_status(int64_t client_id, uint16_t sequence, int chunk_number, int status) {
+    sockaddr_in client_addr{};
+    std::string chunk;
+    lock_clients();
+    auto &&slot = sessions.find(client_id);
+    auto &&buffers = slot == SESSION_NONE ? nullptr : sessions.buffers(slot);
+    if (buffers != nullptr && !buffers->send_buffer.empty() && buffers->send_sequence == sequence) {
+        auto &&send_buffer = buffers->send_buffer;
+        if (status == CHUNK_SUCCESS_MESSAGE && chunk_number == send_buffer.size()) {
+            send_buffer.clear();
+            sessions.release_buffers(slot);
+        } else if (status == CHUNK_REQUEST_MESSAGE && chunk_number < send_buffer.size()) {
+            session_address(client_id, client_addr);
+            chunk = send_buffer[chunk_number];
+        }
     }
+    unlock_clients();
+    if (!chunk.empty()) send_chunk(client_addr, chunk);
 }
 
+bool server::Server::session_address(int64_t client_id, sockaddr_in &client_addr) {
+    auto &&slot = sessions.find(client_id);
+    if (slot == SESSION_NONE) return false;
+    auto &&session = sessions.at(slot);
+    client_addr.sin_family = AF_INET;
+    client_addr.sin_addr.s_addr = session.address;
+    client_addr.sin_port = session.port;
+    return true;
+}
 
-int64_t get_id_for_client_info(sockaddr_in *client_addr) {
-    int64_t result = client_addr->sin_addr.s_addr;
-    return result << 32 | client_addr->sin_port;
+std::string format_address(uint32_t address) {
+    in_addr ip_addr{};
+    ip_addr.s_addr = address;
+    char ip_buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &ip_addr, ip_buf, sizeof(ip_buf));
+    return ip_buf;
 }
 
 int64_t server::Server::get_client_id(sockaddr_in *client_addr) {
-    auto id = get_id_for_client_info(client_addr);
-    if (clients.find(id) == std::end(clients)) {
-        char ip_buf[INET_ADDRSTRLEN];
-        inet_ntop(client_addr->sin_family, &client_addr->sin_addr, ip_buf, sizeof(ip_buf));
-        std::string ip_str(ip_buf);
-        lock_clients();
-        clients[id] = Client{id, ip_str, *client_addr};
-        unlock_clients();
-        Logger::logger_inst->info("New connection from {} with id {}", ip_str, id);
+    auto created = false;
+    lock_clients();
+    sessions.open(client_addr->sin_addr.s_addr, client_addr->sin_port, UDP_PACKET_SIZE, created);
+    unlock_clients();
+    auto &&id = session_id(client_addr->sin_addr.s_addr, client_addr->sin_port);
+    if (created) {
+        Logger::logger_inst->info("New connection from {} with id {}", format_address(client_addr->sin_addr.s_addr), id);
     }
     return id;
 }
 
+int server::Server::receive_datagrams(sockaddr_in &client_addr, size_t &segment_size) {
+#ifdef UDP_RECV_MAX_COALESCED_SIZE
+    if (receive_coalescing) {
+        WSABUF buffer{MESSAGE_SIZE, receive_buffer.data()};
+        char control[WSA_CMSG_SPACE(sizeof(DWORD))] = {};
+        WSAMSG message{};
+        message.name = reinterpret_cast<LPSOCKADDR>(&client_addr);
+        message.namelen = sizeof(client_addr);
+        message.lpBuffers = &buffer;
+        message.dwBufferCount = 1;
+        message.Control.buf = control;
+        message.Control.len = sizeof(control);
+        DWORD bytes = 0;
+        if (receive_message(server_socket, &message, &bytes, nullptr, nullptr) == SOCKET_ERROR) return SOCKET_ERROR;
+        segment_size = bytes;
+        for (auto cmsg = WSA_CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = WSA_CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_COALESCED_INFO) {
+                segment_size = *reinterpret_cast<DWORD *>(WSA_CMSG_DATA(cmsg));
+            }
+        }
+        return static_cast<int>(bytes);
+    }
+#endif
+    socklen_t client_info_size = sizeof(client_addr);
+    auto &&bytes = recvfrom(server_socket, receive_buffer.data(), MESSAGE_SIZE, 0,
+                            reinterpret_cast<sockaddr *>(&client_addr), &client_info_size);
+    segment_size = bytes > 0 ? static_cast<size_t>(bytes) : 0;
+    return bytes;
+}
+
 void server::Server::handle_client_datagram(WSAEVENT event) {
     WSANETWORKEVENTS network_events{};
-    sockaddr client_info{};
-    socklen_t client_info_size = sizeof(sockaddr);
-    char receive_buffer[MESSAGE_SIZE + 1];
+    sockaddr_in client_addr{};
+    size_t segment_size = 0;
     WSAEnumNetworkEvents(server_socket, event, &network_events);
-    auto bytes = recvfrom(server_socket, receive_buffer, MESSAGE_SIZE, 0, &client_info, &client_info_size);
-    auto client_addr = reinterpret_cast<sockaddr_in*>(& client_info);
+    auto bytes = receive_datagrams(client_addr, segment_size);
 
     if (bytes < 0) {
         auto err_code = GetLastError();
         if (err_code == WSAECONNRESET) return;
         Logger::logger_inst->error("Error in recv {}", err_code);
         terminate = true;
+        return;
     }
-    auto client_id = get_client_id(client_addr);
-    refresh_client_timeout(client_id);
-
-    if (bytes == 0)
+    if (bytes == 0 || segment_size == 0)
         return;
 
-    char message_type = receive_buffer[0];
-    if (message_type == CHUNK_REQUEST_MESSAGE || message_type == CHUNK_SUCCESS_MESSAGE) {
-        int message_number = *(int *) (receive_buffer + 1);
-        return client_message_status(client_id, message_number, message_type);
-    } else if (message_type == CONTENT_MESSAGE) {
-        auto *as_int_array = (int *) (receive_buffer + 1);
-        int message_number = as_int_array[0];
-        int message_total = as_int_array[1];
-        receive_buffer[bytes] = '\0';
-        char *content = receive_buffer + 1 + 2 * sizeof(int);
-        std::string message(content);
-        return client_message_chunk(client_id, message_number, message_total, message);
-    } else {
-        Logger::logger_inst->error("Unknown message type");
+    auto &&client_id = session_id(client_addr.sin_addr.s_addr, client_addr.sin_port);
+    auto known = false, looked_up = false;
+    auto &&received = static_cast<size_t>(bytes);
+    for (size_t offset = 0; offset < received; offset += segment_size) {
+        auto &&rest = received - offset;
+        auto &&packet = receive_buffer.data() + offset;
+        auto &&size = rest < segment_size ? rest : segment_size;
+        if (capture) capture->record(CAPTURE_IN, client_id, std::string_view(packet, size));
+        if (protocol::handshake_packet(packet, size)) {
+            if (handle_handshake(client_addr, packet, size)) known = looked_up = true;
+            continue;
+        }
+        protocol::ChunkHeader header{};
+        std::string_view content;
+        if (!protocol::parse_packet(packet, size, header, content)) {
+            LOG_DEBUG("Malformed packet from {}", client_id);
+            continue;
+        }
+        if (!looked_up) {
+            known = refresh_client_timeout(client_id);
+            looked_up = true;
+        }
+        if (known) handle_client_packet(client_id, header, content);
+        else known = handle_handshake(client_addr, packet, size);
+    }
+}
+
+// Nothing is stored for a peer until it echoes a cookie, which a spoofed source never
+// receives. Packets shorter than the cookie are dropped so the reply is never larger.
+// Hellos and cookies are answered without looking up the session, and other packets are
+// only looked up once they parse, so junk from unknown peers never takes the clients lock.
+bool server::Server::handle_handshake(sockaddr_in &client_addr, const char *data, size_t size) {
+    if (size < COOKIE_PACKET_SIZE) return false;
+    auto &&address = client_addr.sin_addr.s_addr;
+    auto &&client_port = client_addr.sin_port;
+    auto &&epoch = protocol::cookie_epoch(static_cast<int64_t>(time(nullptr)));
+    if (protocol::check_cookie(cookie_key, data, size, address, client_port, epoch)) {
+        get_client_id(&client_addr);
+        return true;
+    }
+    send_chunk(client_addr, protocol::cookie_packet(cookie_key, address, client_port, epoch));
+    return false;
+}
+
+void server::Server::handle_client_packet(int64_t client_id, const protocol::ChunkHeader &header,
+                                          std::string_view content) {
+    if (header.type == CHUNK_SIZE_MESSAGE) {
+        return client_chunk_size(client_id, header.number);
+    }
+    if (header.type == CHUNK_REQUEST_MESSAGE || header.type == CHUNK_SUCCESS_MESSAGE) {
+        return client_message_status(client_id, header.sequence, header.number, header.type);
     }
+    return client_message_chunk(client_id, header.sequence, header.number, header.total, content);
 }
 
 void server::Server::serve_loop() {
-    Logger::logger_inst->info("Server started on port {}", SERVER_PORT);
+    Logger::logger_inst->info("Server started on port {}", port);
     WSAEVENT events[1] = {WSACreateEvent()};
     WSAEventSelect(server_socket, events[0], FD_READ);
     while (!terminate) {
@@ -396,20 +766,31 @@ void server::Server::timer_loop() {
     auto timer = CreateWaitableTimer(NULL, TRUE, "Server timer");
     LARGE_INTEGER timer_time{};
     timer_time.QuadPart = -100000000LL;
+    auto maintain_countdown = STORAGE_MAINTAIN_INTERVAL;
     while (!terminate) {
         SetWaitableTimer(timer, &timer_time, 0, NULL, NULL, 0);
         WaitForSingleObject(timer, INFINITE);
-        for (auto &&entry: clients) {
-            ++entry.second.timer;
-            if (entry.second.timer > TIMEOUT_DELTA) {
-                close_client(entry.first);
-            }
+        if (--maintain_countdown == 0) {
+            maintain_countdown = STORAGE_MAINTAIN_INTERVAL;
+            auto &&now = static_cast<int64_t>(time(nullptr));
+            workers.enqueue(&FinanceStorage::maintain, storage.get(), now);
+        }
+        std::vector<int64_t> expired;
+        lock_clients();
+        sessions.for_each([&](uint32_t slot) {
+            auto &&session = sessions.at(slot);
+            if (++session.idle_ticks > TIMEOUT_DELTA) expired.push_back(sessions.id(slot));
+        });
+        unlock_clients();
+        for (auto &&client_id: expired) {
+            close_client(client_id);
         }
     }
 }
 
-void server::Server::start() {
+void server::Server::start(std::chrono::steady_clock::time_point launch_time) {
     terminate = false;
+    launched_at = launch_time;
     server_thread = std::move(std::thread(&Server::serve_loop, this));
     timer_thread = std::move(std::thread(&Server::timer_loop, this));
 }
@@ -418,21 +799,31 @@ bool server::Server::is_active() {
     return !terminate;
 }
 
+void server::Server::set_read_only(bool value) {
+    read_only = value;
+}
+
+void server::Server::start_capture(const std::string &path) {
+    capture = std::make_unique<Capture>(path);
+}
+
 void server::Server::close_all_clients() {
-    auto &&it = std::begin(clients);
-    while (it != std::end(clients)) {
-        close_client(it->first);
-        it = std::begin(clients);
+    std::vector<int64_t> open;
+    lock_clients();
+    sessions.for_each([&](uint32_t slot) { open.push_back(sessions.id(slot)); });
+    unlock_clients();
+    for (auto &&client_id: open) {
+        close_client(client_id);
     }
 }
 
 std::string server::Server::list_clients() {
     std::stringstream out_string;
     out_string << "Clients connected:";
-    for (auto &&entry: clients) {
-        auto &&client_id = entry.first;
-        auto &&client = entry.second;
-        out_string << "\nid: " << client_id << " " << client.ip_str;
-    }
+    lock_clients();
+    sessions.for_each([&](uint32_t slot) {
+        out_string << "\nid: " << sessions.id(slot) << " " << format_address(sessions.at(slot).address);
+    });
+    unlock_clients();
     return out_string.str();
 }
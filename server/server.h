@@ -3,54 +3,42 @@
 
 #include <mutex>
 #include <vector>
-#include <unordered_map>
 #include <memory>
 #include <atomic>
+#include <chrono>
 
 #include<winsock2.h>
+#include <mswsock.h>
 #pragma comment(lib,"ws2_32.lib")
 
 #include "thread_pool/ThreadPool.h"
-#include "database/FinanceDb.h"
+#include "database/FinanceStorage.h"
+#include "database/ChangeLog.h"
+#include "protocol/chunking.h"
+#include "protocol/handshake.h"
+#include "protocol/request.h"
 #include "defines.h"
+#include "sessions.h"
+#include "capture.h"
 
 #define TIMEOUT_DELTA 30
-#define UDP_PACKET_SIZE 256
+#define STORAGE_MAINTAIN_INTERVAL 30
+#define EXPORT_DIR "exports"
 
 namespace server {
-    class Client {
-    public:
-        Client() : descriptor(0), timer(0), ip_addr{} {}
-
-        explicit Client(int64_t descriptor, std::string &ip_str, sockaddr_in& ip_addr) :
-                descriptor(descriptor), timer(0), ip_str(ip_str), ip_addr(ip_addr) {}
-
-        Client &operator=(Client &&other) noexcept {
-            if (this != &other) {
-                descriptor = other.descriptor;
-                receive_buffer = std::move(other.receive_buffer);
-                send_buffer = std::move(other.send_buffer);
-                timer = other.timer;
-                ip_str = std::move(other.ip_str);
-                ip_addr = other.ip_addr;
-            }
-            return *this;
-        }
-
-        int64_t descriptor;
-        int timer;
-        std::vector<std::string> send_buffer;
-        std::vector<std::string> receive_buffer;
-        std::string ip_str;
-        sockaddr_in ip_addr;
-    };
-
-
     class Server {
 
     public:
-        Server() : server_socket(0), terminate(false), workers(4), database(), clients_lock() {
+        // replication_log, when given, is the storage itself or wraps it and lets replicas follow this server.
+        explicit Server(std::unique_ptr<FinanceStorage> finance_storage, uint16_t server_port = SERVER_PORT,
+                        ChangeLog *replication_log = nullptr) :
+                server_socket(0), port(server_port), read_only(false), export_running(false), terminate(false),
+                storage(std::move(finance_storage)), change_log(replication_log), workers(4), clients_lock(),
+                first_request_served(false), segmentation_offload(false), receive_coalescing(false),
+                receive_message(nullptr),
+                receive_buffer(MESSAGE_SIZE + 1) {
             create_server_socket();
+            create_cookie_key();
             InitializeCriticalSection(&clients_lock);
         }
 
@@ -62,35 +50,54 @@ namespace server {
     private:
         void create_server_socket();
 
-        void handle_client_if_possible(int64_t client_id);
+        void enable_offload(SOCKET server_d);
+
+        void create_cookie_key();
+
+        // Runs a complete request on a worker.
+        void dispatch_message(const std::string &received, int64_t client_id, uint16_t sequence);
+
+        void process_client_message(std::string &message, int64_t client_id, uint16_t sequence);
+
+        void process_client_command(std::string_view command, int64_t client_id, uint16_t sequence);
 
-        void process_client_message(std::string &message, int64_t client_id);
+        void process_client_text(std::string_view text, int64_t client_id, uint16_t sequence);
 
-        void process_client_command(std::string_view command, int64_t client_id);
+        void process_client_json(std::string_view json_string, int64_t client_id, uint16_t sequence);
 
-        void process_client_text(std::string_view text, int64_t client_id);
+        void process_add_currency(std::string &currency, int64_t client_id, uint16_t sequence);
 
-        void process_client_json(std::string_view json_string, int64_t client_id);
+        void process_add_currency_value(std::string &currency, double value, int64_t client_id,
+                                        uint16_t sequence);
 
-        void process_add_currency(std::string &currency, int64_t client_id);
+        void process_del_currency(std::string &currency, int64_t client_id, uint16_t sequence);
 
-        void process_add_currency_value(std::string &currency, double value, int64_t client_id);
+        void process_list_all_currencies(int64_t client_id, uint16_t sequence, bool compact = false);
 
-        void process_del_currency(std::string &currency, int64_t client_id);
+        void process_currency_history(std::string &currency, int64_t client_id, uint16_t sequence,
+                                      bool compact = false);
 
-        void process_list_all_currencies(int64_t client_id);
+        void process_get_changes(uint64_t since, int64_t client_id, uint16_t sequence);
 
-        void process_currency_history(std::string &currency, int64_t client_id);
+        void process_snapshot(std::string &currency, int64_t client_id, uint16_t sequence);
+
+        void process_export(protocol::Request &request, int64_t client_id, uint16_t sequence);
 
         void serve_loop();
 
     public:
         void stop();
 
-        void start();
+        void start(std::chrono::steady_clock::time_point launch_time = std::chrono::steady_clock::now());
 
         bool is_active();
 
+        // Writes from clients are rejected, used by replicas.
+        void set_read_only(bool value);
+
+        // Records every datagram to path until the server is destroyed, call before start.
+        void start_capture(const std::string &path);
+
         void close_client(int64_t client_d);
 
         void close_all_clients();
@@ -98,17 +105,36 @@ namespace server {
         std::string list_clients();
 
     private:
-        std::unordered_map<int64_t , Client> clients;
+        SessionTable sessions;
         std::thread server_thread;
         std::thread timer_thread;
         CRITICAL_SECTION clients_lock;
+        std::unique_ptr<FinanceStorage> storage;
+        ChangeLog *change_log;
+        std::unique_ptr<Capture> capture;
         ThreadPool workers;
-        FinanceDb database;
         volatile std::atomic_bool terminate;
+        std::chrono::steady_clock::time_point launched_at;
+        std::atomic_bool first_request_served;
         SOCKET server_socket;
+        uint16_t port;
+        std::atomic_bool read_only;
+        std::atomic_bool export_running;
+        std::atomic_bool segmentation_offload;
+        bool receive_coalescing;
+        LPFN_WSARECVMSG receive_message;
+        protocol::CookieKey cookie_key;
+        std::vector<char> receive_buffer;
 
         void handle_client_datagram(WSAEVENT);
 
+        int receive_datagrams(sockaddr_in &client_addr, size_t &segment_size);
+
+        void handle_client_packet(int64_t client_id, const protocol::ChunkHeader &header, std::string_view content);
+
+        // Answers a packet from an address without a session, returns true once it has one.
+        bool handle_handshake(sockaddr_in &client_addr, const char *data, size_t size);
+
         void lock_clients(){
             EnterCriticalSection(&clients_lock);
         }
@@ -117,17 +143,28 @@ namespace server {
             LeaveCriticalSection(&clients_lock);
         }
 
-        void refresh_client_timeout(int64_t client_id);
+        bool refresh_client_timeout(int64_t client_id);
+
+        void client_message_status(int64_t client_id, uint16_t sequence, int chunk_number, int status);
 
-        void client_message_status(int64_t client_id, int chunk_number, int status);
+        void client_message_chunk(int64_t client_id, uint16_t sequence, int chunk_number, int total,
+                                  std::string_view chunk);
 
-        void client_message_chunk(int64_t client_id, int chunk_number, int total, std::string& message);
+        void client_chunk_size(int64_t client_id, int32_t requested);
 
         int64_t get_client_id(sockaddr_in *client_addr);
 
+        // Fills client_addr with the address of an open session, called with the clients lock held.
+        bool session_address(int64_t client_id, sockaddr_in &client_addr);
+
         void timer_loop();
 
-        void send_message(int64_t client_id, std::string_view message);
+        // Drops the reply when the session has moved on to a later request.
+        void send_message(int64_t client_id, uint16_t sequence, std::string_view message);
+
+        void send_chunks(sockaddr_in &client_addr, const std::vector<std::string> &packets);
+
+        bool send_segmented(sockaddr_in &client_addr, const protocol::SegmentBatch &batch);
 
         void send_chunk(sockaddr_in &client_addr, std::string_view message);
 
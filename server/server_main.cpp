@@ -1,6 +1,82 @@
 #include <iostream>
 #include <sstream>
 #include "server.h"
+#include "replica.h"
+#include "database/FinanceDb.h"
+#include "database/MemoryStorage.h"
+#include "database/ShardedStorage.h"
+#include "logging/logger.h"
+
+#define STORAGE_SQLITE "sqlite"
+#define STORAGE_MEMORY "memory"
+#define STORAGE_SHARDED "sharded"
+#define REPLICA_DB_PATH "replica.db"
+#define REPLICA_MEMORY_PATH "replica_mem"
+
+struct ServerConfig {
+    std::string storage = STORAGE_SQLITE;
+    std::string db_path;
+    size_t shards = DEFAULT_SHARDS;
+    uint16_t port = SERVER_PORT;
+    std::string primary_host;
+    uint16_t primary_port = SERVER_PORT;
+    std::string capture_path;
+    // Empty unless --retention is given, which keeps every tick.
+    RetentionPolicy retention;
+};
+
+void usage() {
+    std::cerr << "usage: server [--storage=sqlite|memory|sharded] [--db=path] [--shards=N] [--port=N]"
+              << " [--replica-of=host[:port]] [--capture=path]"
+              << " [--retention=age:resolution,...]" << std::endl;
+}
+
+bool parse_args(int argc, char **argv, ServerConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        auto &&separator = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || separator == std::string::npos) return false;
+        auto &&key = arg.substr(2, separator - 2);
+        auto &&value = arg.substr(separator + 1);
+        if (key == "storage") config.storage = value;
+        else if (key == "db") config.db_path = value;
+        else if (key == "shards") config.shards = std::stoul(value);
+        else if (key == "capture") config.capture_path = value;
+        else if (key == "retention") {
+            if (!parse_retention(value, config.retention)) return false;
+        }
+        else if (key == "port") config.port = static_cast<uint16_t>(std::stoul(value));
+        else if (key == "replica-of") {
+            auto &&port_separator = value.rfind(':');
+            config.primary_host = value.substr(0, port_separator);
+            if (port_separator != std::string::npos) {
+                config.primary_port = static_cast<uint16_t>(std::stoul(value.substr(port_separator + 1)));
+            }
+        }
+        else return false;
+    }
+    if (config.shards == 0) return false;
+    return config.storage == STORAGE_SQLITE || config.storage == STORAGE_MEMORY || config.storage == STORAGE_SHARDED;
+}
+
+// A replica copies everything from its primary, so its own files are reset on start.
+std::unique_ptr<FinanceStorage> create_storage(const ServerConfig &config) {
+    auto &&replica = !config.primary_host.empty();
+    if (config.storage == STORAGE_MEMORY) {
+        auto &&memory_path = !config.db_path.empty() ? config.db_path
+                                                     : std::string(replica ? REPLICA_MEMORY_PATH : MEMORY_STORAGE_PATH);
+        if (replica) MemoryStorage::reset(memory_path);
+        return std::make_unique<MemoryStorage>(memory_path);
+    }
+    auto &&db_path = !config.db_path.empty() ? config.db_path
+                                             : std::string(replica ? REPLICA_DB_PATH : FINANCE_DB_PATH);
+    if (config.storage == STORAGE_SHARDED) {
+        if (replica) ShardedStorage::reset(db_path, config.shards);
+        return std::make_unique<ShardedStorage>(db_path, config.shards);
+    }
+    if (replica) FinanceDb::reset(db_path);
+    return std::make_unique<FinanceDb>(db_path);
+}
 
 void help() {
     std::stringstream out_string;
@@ -9,20 +85,55 @@ void help() {
     out_string << "list: list connected clients\n";
     out_string << "kill [id]: disconnect client with specified id\n";
     out_string << "killall: disconnect all clients\n";
+    out_string << "replication: show replication lag of a replica\n";
     out_string << "shutdown: shutdown server\n";
 
     std::cout << out_string.str() << std::endl;
 }
 
 int main(int argc, char **argv) {
-    auto &&server = server::Server();
-    server.start();
+    auto &&launch_time = std::chrono::steady_clock::now();
+    ServerConfig config;
+    if (!parse_args(argc, argv, config)) {
+        usage();
+        return 1;
+    }
+    Logger::logger_inst->info("Using {} storage", config.storage);
+    auto &&storage = create_storage(config);
+    auto &&local_storage = storage.get();
+    storage->set_retention(config.retention);
+    ChangeLog *change_log = nullptr;
+    if (config.primary_host.empty()) {
+        auto &&logged = std::make_unique<ChangeLog>(std::move(storage));
+        change_log = logged.get();
+        storage = std::move(logged);
+    }
+    auto &&server = server::Server(std::move(storage), config.port, change_log);
+    auto &&ready_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - launch_time).count();
+    Logger::logger_inst->info("Storage ready in {} ms", ready_ms);
+    std::unique_ptr<server::Replica> replica;
+    if (!config.primary_host.empty()) {
+        server.set_read_only(true);
+        replica = std::make_unique<server::Replica>(*local_storage, config.primary_host, config.primary_port);
+        replica->start();
+    }
+    if (!config.capture_path.empty()) {
+        try {
+            server.start_capture(config.capture_path);
+        } catch (std::exception &ex) {
+            Logger::logger_inst->error("{}", ex.what());
+            return 1;
+        }
+    }
+    server.start(launch_time);
     std::string command;
     while (server.is_active()) {
         std::getline(std::cin, command);
         if (command == "help") help();
         else if (command == "list") std::cout << server.list_clients() << std::endl;
         else if (command == "killall") server.close_all_clients();
+        else if (command == "replication") std::cout << (replica ? replica->status() : "Not a replica") << std::endl;
         else if (!command.compare(0, 4, "kill")) {
             auto&& client_id = std::stoi(command.substr(5));
             server.close_client(client_id);
@@ -30,5 +141,7 @@ int main(int argc, char **argv) {
             break;
         }
     }
+    if (replica) replica->stop();
     server.stop();
+    Logger::logger_inst->flush();
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "sessions.h"
+
+int64_t server::session_id(uint32_t address, uint16_t port) {
+    return static_cast<int64_t>(static_cast<uint64_t>(address) << 32 | port);
+}
+
+server::SessionTable::SessionTable() :
+        index(SESSION_INDEX_MIN_SIZE, 0), free_slot(SESSION_NONE), live(0), index_bits(0) {
+    while ((size_t(1) << index_bits) < index.size()) ++index_bits;
+}
+
+size_t server::SessionTable::home(int64_t id) const {
+    return static_cast<size_t>((static_cast<uint64_t>(id) * 0x9E3779B97F4A7C15ull) >> (64 - index_bits));
+}
+
+int64_t server::SessionTable::id(uint32_t slot) const {
+    return session_id(slots[slot].address, slots[slot].port);
+}
+
+// The index holds slot + 1, zero marks an empty entry.
+uint32_t server::SessionTable::find(int64_t id) const {
+    auto &&mask = index.size() - 1;
+    for (auto position = home(id); index[position] != 0; position = (position + 1) & mask) {
+        auto &&slot = index[position] - 1;
+        if (session_id(slots[slot].address, slots[slot].port) == id) return slot;
+    }
+    return SESSION_NONE;
+}
+
+uint32_t server::SessionTable::open(uint32_t address, uint16_t port, uint16_t chunk_size, bool &created) {
+    auto &&existing = find(session_id(address, port));
+    created = existing == SESSION_NONE;
+    if (!created) return existing;
+    if ((live + 1) * 4 > index.size() * 3) grow_index();
+    uint32_t slot;
+    if (free_slot != SESSION_NONE) {
+        slot = free_slot;
+        free_slot = slots[slot].buffers;
+    } else {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+    }
+    slots[slot] = Session{address, port, chunk_size, 0, 0, 0};
+    index_insert(slot);
+    ++live;
+    return slot;
+}
+
+void server::SessionTable::close(uint32_t slot) {
+    auto &&id = this->id(slot);
+    auto &&mask = index.size() - 1;
+    auto position = home(id);
+    while (index[position] != slot + 1) position = (position + 1) & mask;
+    index_erase(position);
+    auto &&session = slots[slot];
+    if (session.buffers != 0) {
+        buffer_pool[session.buffers - 1].reset();
+        free_buffers.push_back(session.buffers - 1);
+    }
+    session = Session{0, 0, 0, 0, 0, free_slot};
+    free_slot = slot;
+    --live;
+}
+
+void server::SessionTable::index_insert(uint32_t slot) {
+    auto &&mask = index.size() - 1;
+    auto position = home(id(slot));
+    while (index[position] != 0) position = (position + 1) & mask;
+    index[position] = slot + 1;
+}
+
+// Later entries of the probe run are moved back so that lookups need no tombstones.
+void server::SessionTable::index_erase(size_t position) {
+    auto &&mask = index.size() - 1;
+    index[position] = 0;
+    auto next = position;
+    while (true) {
+        next = (next + 1) & mask;
+        if (index[next] == 0) return;
+        auto &&wanted = home(id(index[next] - 1));
+        auto &&displaced = next > position ? (wanted <= position || wanted > next)
+                                           : (wanted <= position && wanted > next);
+        if (displaced) {
+            index[position] = index[next];
+            index[next] = 0;
+            position = next;
+        }
+    }
+}
+
+void server::SessionTable::grow_index() {
+    index.assign(index.size() * 2, 0);
+    ++index_bits;
+    for (uint32_t slot = 0; slot < slots.size(); ++slot) {
+        if (in_use(slots[slot])) index_insert(slot);
+    }
+}
+
+std::shared_ptr<server::SessionBuffers> server::SessionTable::attach_buffers(uint32_t slot) {
+    auto &&session = slots[slot];
+    if (session.buffers == 0) {
+        if (free_buffers.empty()) {
+            buffer_pool.emplace_back();
+            free_buffers.push_back(static_cast<uint32_t>(buffer_pool.size() - 1));
+        }
+        uint32_t position = free_buffers.back();
+        free_buffers.pop_back();
+        buffer_pool[position] = std::make_shared<SessionBuffers>();
+        session.buffers = position + 1;
+    }
+    return buffer_pool[session.buffers - 1];
+}
+
+server::SessionBuffers *server::SessionTable::buffers(uint32_t slot) {
+    auto &&session = slots[slot];
+    return session.buffers == 0 ? nullptr : buffer_pool[session.buffers - 1].get();
+}
+
+void server::SessionTable::release_buffers(uint32_t slot) {
+    auto &&session = slots[slot];
+    if (session.buffers == 0) return;
+    auto &&attached = buffer_pool[session.buffers - 1];
+    if (!attached->send_buffer.empty() || !attached->receive_buffer.empty()) return;
+    attached.reset();
+    free_buffers.push_back(session.buffers - 1);
+    session.buffers = 0;
+}
+
+size_t server::SessionTable::memory_usage() const {
+    auto &&total = slots.capacity() * sizeof(Session) + index.capacity() * sizeof(uint32_t) +
+                   buffer_pool.capacity() * sizeof(std::shared_ptr<SessionBuffers>) +
+                   free_buffers.capacity() * sizeof(uint32_t);
+    for (auto &&attached: buffer_pool) {
+        if (attached) total += sizeof(SessionBuffers);
+    }
+    return total;
+}
@@ -0,0 +1,107 @@
+#ifndef ECHOSERVER_SESSIONS_H
+#define ECHOSERVER_SESSIONS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define SESSION_NONE UINT32_MAX
+#define SESSION_INDEX_MIN_SIZE 1024
+
+namespace server {
+
+    // Chunks of the message being sent to or received from a peer. They only exist while
+    // a message is in flight.
+    struct SessionBuffers {
+        std::vector<std::string> send_buffer;
+        std::vector<std::string> receive_buffer;
+        uint16_t send_sequence = 0;
+        uint16_t receive_sequence = 0;
+    };
+
+    // Everything kept for an idle peer. Address and port are in network order, as they come
+    // in sockaddr_in, and together make the client id. sequence is the last request taken
+    // from the peer, 0 before the first one. A free slot has address and port set to zero
+    // and links to the next free slot through buffers.
+    struct Session {
+        uint32_t address;
+        uint16_t port;
+        uint16_t chunk_size;
+        uint16_t idle_ticks;
+        uint16_t sequence;
+        uint32_t buffers;
+    };
+
+    int64_t session_id(uint32_t address, uint16_t port);
+
+    // Sessions live in one array and are found through an open addressing index keyed by the
+    // client id, so an idle peer costs a few dozen bytes and no allocations of its own. Slots
+    // are reused after close. The table is not synchronized.
+    class SessionTable {
+    public:
+        SessionTable();
+
+        // SESSION_NONE when there is no such session.
+        uint32_t find(int64_t id) const;
+
+        // Returns the slot of the peer, opening a session for it if there is none yet.
+        uint32_t open(uint32_t address, uint16_t port, uint16_t chunk_size, bool &created);
+
+        void close(uint32_t slot);
+
+        Session &at(uint32_t slot) {
+            return slots[slot];
+        }
+
+        int64_t id(uint32_t slot) const;
+
+        // Creates the buffers of the session if it has none. The returned pointer keeps them
+        // alive after they are released.
+        std::shared_ptr<SessionBuffers> attach_buffers(uint32_t slot);
+
+        // nullptr when the session has no buffers.
+        SessionBuffers *buffers(uint32_t slot);
+
+        // Drops the buffers once nothing is being sent or received.
+        void release_buffers(uint32_t slot);
+
+        size_t size() const {
+            return live;
+        }
+
+        size_t memory_usage() const;
+
+        // visit(slot) is called for every open session and may close it.
+        template<typename Visit>
+        void for_each(Visit &&visit) {
+            for (uint32_t slot = 0; slot < slots.size(); ++slot) {
+                if (in_use(slots[slot])) visit(slot);
+            }
+        }
+
+    private:
+        static bool in_use(const Session &session) {
+            return session.address != 0 || session.port != 0;
+        }
+
+        size_t home(int64_t id) const;
+
+        void index_insert(uint32_t slot);
+
+        void index_erase(size_t position);
+
+        void grow_index();
+
+        std::vector<Session> slots;
+        std::vector<uint32_t> index;
+        std::vector<std::shared_ptr<SessionBuffers>> buffer_pool;
+        std::vector<uint32_t> free_buffers;
+        uint32_t free_slot;
+        size_t live;
+        int index_bits;
+    };
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _BINARY_IO
+#define _BINARY_IO
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Fixed-size values are stored in host byte order: the files written with these helpers
+// are only read back by the process that wrote them or one on the same machine.
+namespace codec {
+
+    template<typename T>
+    inline void write_pod(std::string &out, const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "write_pod needs a trivially copyable type");
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    inline bool read_pod(std::string_view &in, T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "read_pod needs a trivially copyable type");
+        if (in.size() < sizeof(T)) return false;
+        std::memcpy(&value, in.data(), sizeof(T));
+        in.remove_prefix(sizeof(T));
+        return true;
+    }
+
+    // Longer strings than a u16 length can describe throw instead of being cut short.
+    inline void write_string(std::string &out, std::string_view value) {
+        if (value.size() > UINT16_MAX) throw std::length_error("String too long to write");
+        write_pod(out, static_cast<uint16_t>(value.size()));
+        out.append(value.data(), value.size());
+    }
+
+    inline bool read_string(std::string_view &in, std::string_view &value) {
+        uint16_t size;
+        if (!read_pod(in, size) || in.size() < size) return false;
+        value = in.substr(0, size);
+        in.remove_prefix(size);
+        return true;
+    }
+
+    // FNV-1a, enough to notice torn writes and truncated files.
+    inline uint64_t checksum(std::string_view data) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (auto &&byte: data) {
+            hash ^= static_cast<uint8_t>(byte);
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+}
+
+#endif
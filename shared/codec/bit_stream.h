@@ -0,0 +1,112 @@
+#ifndef _BIT_STREAM
+#define _BIT_STREAM
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace codec {
+
+    class BitWriter {
+    public:
+        explicit BitWriter(std::string &out) : out(out), current(0), used(0) {}
+
+        void write_bit(bool bit) {
+            current = static_cast<uint8_t>(current << 1 | (bit ? 1 : 0));
+            if (++used == 8) flush_byte();
+        }
+
+        void write_bits(uint64_t bits, int count) {
+            while (count > 0) {
+                int free_bits = 8 - used;
+                int take = count < free_bits ? count : free_bits;
+                count -= take;
+                auto &&part = static_cast<uint8_t>((bits >> count) & ((1u << take) - 1));
+                current = static_cast<uint8_t>(current << take | part);
+                used += take;
+                if (used == 8) flush_byte();
+            }
+        }
+
+        void finish() {
+            if (used == 0) return;
+            current = static_cast<uint8_t>(current << (8 - used));
+            flush_byte();
+        }
+
+    private:
+        void flush_byte() {
+            out.push_back(static_cast<char>(current));
+            current = 0;
+            used = 0;
+        }
+
+        std::string &out;
+        uint8_t current;
+        int used;
+    };
+
+    class BitReader {
+    public:
+        explicit BitReader(std::string_view data) : data(data), position(0) {}
+
+        bool read_bit(bool &bit) {
+            uint64_t value;
+            if (!read_bits(value, 1)) return false;
+            bit = value != 0;
+            return true;
+        }
+
+        bool read_bits(uint64_t &value, int count) {
+            if (position + count > data.size() * 8) return false;
+            value = 0;
+            while (count > 0) {
+                auto &&byte = static_cast<uint8_t>(data[position / 8]);
+                int available = 8 - static_cast<int>(position % 8);
+                int take = count < available ? count : available;
+                auto &&part = (byte >> (available - take)) & ((1u << take) - 1);
+                value = value << take | part;
+                position += take;
+                count -= take;
+            }
+            return true;
+        }
+
+        size_t bytes_consumed() const {
+            return (position + 7) / 8;
+        }
+
+    private:
+        std::string_view data;
+        size_t position;
+    };
+
+    inline void write_varint(std::string &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline bool read_varint(std::string_view &in, uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+            auto &&byte = static_cast<uint8_t>(in[0]);
+            in.remove_prefix(1);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return false;
+    }
+
+    inline uint64_t zigzag_encode(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t zigzag_decode(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+}
+
+#endif
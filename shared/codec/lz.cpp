@@ -0,0 +1,102 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "lz.h"
+
+namespace {
+    uint32_t read32(const char *data) {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint32_t hash32(uint32_t value) {
+        return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+
+    void write_length(std::string &out, size_t length) {
+        while (length >= 255) {
+            out.push_back(static_cast<char>(255));
+            length -= 255;
+        }
+        out.push_back(static_cast<char>(length));
+    }
+
+    bool read_length(std::string_view input, size_t &position, size_t &length) {
+        while (position < input.size()) {
+            auto &&byte = static_cast<uint8_t>(input[position++]);
+            length += byte;
+            if (byte != 255) return true;
+        }
+        return false;
+    }
+
+    void emit_sequence(std::string &out, std::string_view literals, size_t offset, size_t match_length) {
+        size_t literal_nibble = literals.size() < 15 ? literals.size() : 15;
+        size_t match_nibble = 0;
+        if (match_length != 0) {
+            match_nibble = match_length - LZ_MIN_MATCH < 15 ? match_length - LZ_MIN_MATCH : 15;
+        }
+        out.push_back(static_cast<char>(literal_nibble << 4 | match_nibble));
+        if (literal_nibble == 15) write_length(out, literals.size() - 15);
+        out.append(literals.data(), literals.size());
+        if (match_length == 0) return;
+        out.push_back(static_cast<char>(offset & 0xFF));
+        out.push_back(static_cast<char>(offset >> 8));
+        if (match_nibble == 15) write_length(out, match_length - LZ_MIN_MATCH - 15);
+    }
+}
+
+void codec::lz_compress(std::string_view input, std::string &out) {
+    std::vector<int64_t> table(static_cast<size_t>(1) << LZ_HASH_BITS, -1);
+    auto &&data = input.data();
+    auto &&size = input.size();
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + LZ_MIN_MATCH <= size) {
+        auto &&sequence = read32(data + position);
+        auto &&slot = hash32(sequence);
+        int64_t candidate = table[slot];
+        table[slot] = static_cast<int64_t>(position);
+        if (candidate < 0 || position - candidate > LZ_MAX_OFFSET || read32(data + candidate) != sequence) {
+            ++position;
+            continue;
+        }
+        size_t match_length = LZ_MIN_MATCH;
+        while (position + match_length < size && data[candidate + match_length] == data[position + match_length]) {
+            ++match_length;
+        }
+        emit_sequence(out, input.substr(anchor, position - anchor), position - candidate, match_length);
+        position += match_length;
+        anchor = position;
+    }
+    emit_sequence(out, input.substr(anchor), 0, 0);
+}
+
+bool codec::lz_decompress(std::string_view input, size_t raw_size, std::string &out) {
+    out.clear();
+    if (raw_size / LZ_MAX_EXPANSION > input.size()) return false;
+    out.reserve(raw_size);
+    size_t position = 0;
+    while (position < input.size()) {
+        auto &&token = static_cast<uint8_t>(input[position++]);
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(input, position, literal_length)) return false;
+        if (position + literal_length > input.size()) return false;
+        out.append(input.data() + position, literal_length);
+        position += literal_length;
+        if (position == input.size()) break;
+        if (position + 2 > input.size()) return false;
+        size_t offset = static_cast<uint8_t>(input[position]) | static_cast<uint8_t>(input[position + 1]) << 8;
+        position += 2;
+        size_t match_length = (token & 0x0F);
+        if (match_length == 15 && !read_length(input, position, match_length)) return false;
+        match_length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out.size() || out.size() + match_length > raw_size) return false;
+        auto &&from = out.size() - offset;
+        for (size_t i = 0; i < match_length; ++i) {
+            out.push_back(out[from + i]);
+        }
+    }
+    return out.size() == raw_size;
+}
@@ -0,0 +1,21 @@
+#ifndef _LZ
+#define _LZ
+
+#include <string>
+#include <string_view>
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+// A length byte adds at most 255 bytes of output, so no input expands by more than this.
+#define LZ_MAX_EXPANSION 255
+
+namespace codec {
+
+    void lz_compress(std::string_view input, std::string &out);
+
+    // Fails without allocating when raw_size is more than input could expand to.
+    bool lz_decompress(std::string_view input, size_t raw_size, std::string &out);
+}
+
+#endif
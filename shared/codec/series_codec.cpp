@@ -0,0 +1,125 @@
+#include <cstring>
+#include "series_codec.h"
+#include "bit_stream.h"
+#include "xor_codec.h"
+#include "lz.h"
+#include "defines.h"
+
+namespace {
+    template<typename Field>
+    void encode_values(const codec::Series &series, Field field, std::string &out) {
+        std::string bits;
+        codec::BitWriter writer(bits);
+        codec::XorEncoder encoder(writer);
+        for (auto &&tick: series.ticks) encoder.add(tick.*field);
+        writer.finish();
+        codec::write_varint(out, bits.size());
+        out += bits;
+    }
+
+    template<typename Field>
+    bool decode_values(std::string_view &in, Field field, codec::Series &series) {
+        uint64_t size;
+        if (!codec::read_varint(in, size) || size > in.size()) return false;
+        codec::BitReader reader(in.substr(0, size));
+        codec::XorDecoder decoder(reader);
+        for (auto &&tick: series.ticks) {
+            if (!decoder.next(tick.*field)) return false;
+        }
+        in.remove_prefix(size);
+        return true;
+    }
+
+    void encode_body(const std::vector<codec::Series> &series, bool with_increments, std::string &out) {
+        codec::write_varint(out, series.size());
+        for (auto &&item: series) {
+            codec::write_varint(out, item.currency.size());
+            out += item.currency;
+            codec::write_varint(out, item.ticks.size());
+            int64_t previous = 0;
+            for (auto &&tick: item.ticks) {
+                codec::write_varint(out, codec::zigzag_encode(tick.timestamp - previous));
+                previous = tick.timestamp;
+            }
+            encode_values(item, &codec::Tick::value, out);
+            if (!with_increments) continue;
+            encode_values(item, &codec::Tick::inc_rel, out);
+            encode_values(item, &codec::Tick::inc_abs, out);
+        }
+    }
+
+    bool decode_body(std::string_view in, bool with_increments, std::vector<codec::Series> &series) {
+        uint64_t count;
+        if (!codec::read_varint(in, count)) return false;
+        series.clear();
+        for (uint64_t i = 0; i < count; ++i) {
+            codec::Series item;
+            uint64_t name_size, ticks;
+            if (!codec::read_varint(in, name_size) || name_size > in.size()) return false;
+            item.currency.assign(in.data(), name_size);
+            in.remove_prefix(name_size);
+            if (!codec::read_varint(in, ticks) || ticks > in.size()) return false;
+            item.ticks.resize(ticks, codec::Tick{0, 0, 0, 0});
+            int64_t previous = 0;
+            for (auto &&tick: item.ticks) {
+                uint64_t delta;
+                if (!codec::read_varint(in, delta)) return false;
+                tick.timestamp = previous + codec::zigzag_decode(delta);
+                previous = tick.timestamp;
+            }
+            if (!decode_values(in, &codec::Tick::value, item)) return false;
+            if (with_increments && (!decode_values(in, &codec::Tick::inc_rel, item) ||
+                                    !decode_values(in, &codec::Tick::inc_abs, item))) {
+                return false;
+            }
+            series.emplace_back(std::move(item));
+        }
+        return in.empty();
+    }
+}
+
+void codec::encode_series(const std::vector<Series> &series, bool with_increments, std::string &out) {
+    std::string body;
+    encode_body(series, with_increments, body);
+    std::string compressed;
+    lz_compress(body, compressed);
+    auto &&use_compressed = compressed.size() < body.size();
+    out.push_back(static_cast<char>(SERIES_CODEC_VERSION));
+    auto &&flags = (use_compressed ? SERIES_FLAG_COMPRESSED : 0) | (with_increments ? SERIES_FLAG_INCREMENTS : 0);
+    out.push_back(static_cast<char>(flags));
+    write_varint(out, body.size());
+    out += use_compressed ? compressed : body;
+}
+
+bool codec::decode_series(std::string_view data, std::vector<Series> &series) {
+    if (data.size() < 2 || static_cast<uint8_t>(data[0]) != SERIES_CODEC_VERSION) return false;
+    auto &&flags = static_cast<uint8_t>(data[1]);
+    data.remove_prefix(2);
+    uint64_t raw_size;
+    if (!read_varint(data, raw_size)) return false;
+    auto &&with_increments = (flags & SERIES_FLAG_INCREMENTS) != 0;
+    if ((flags & SERIES_FLAG_COMPRESSED) == 0) return decode_body(data, with_increments, series);
+    std::string body;
+    if (!lz_decompress(data, raw_size, body)) return false;
+    return decode_body(body, with_increments, series);
+}
+
+std::string codec::series_message(const std::vector<Series> &series, bool with_increments) {
+    std::string payload;
+    encode_series(series, with_increments, payload);
+    auto &&size = static_cast<uint32_t>(payload.size());
+    std::string message(BIN_PREFIX);
+    message.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    message += payload;
+    message += MESSAGE_END;
+    return message;
+}
+
+bool codec::parse_series_message(std::string_view message, std::vector<Series> &series) {
+    uint32_t size;
+    if (message.size() < sizeof(size)) return false;
+    std::memcpy(&size, message.data(), sizeof(size));
+    message.remove_prefix(sizeof(size));
+    if (message.size() < size) return false;
+    return decode_series(message.substr(0, size), series);
+}
@@ -0,0 +1,36 @@
+#ifndef _SERIES_CODEC
+#define _SERIES_CODEC
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define SERIES_CODEC_VERSION 1
+#define SERIES_FLAG_COMPRESSED 1
+#define SERIES_FLAG_INCREMENTS 2
+
+namespace codec {
+
+    struct Tick {
+        int64_t timestamp;
+        double value;
+        double inc_rel;
+        double inc_abs;
+    };
+
+    struct Series {
+        std::string currency;
+        std::vector<Tick> ticks;
+    };
+
+    void encode_series(const std::vector<Series> &series, bool with_increments, std::string &out);
+
+    bool decode_series(std::string_view data, std::vector<Series> &series);
+
+    std::string series_message(const std::vector<Series> &series, bool with_increments);
+
+    bool parse_series_message(std::string_view message, std::vector<Series> &series);
+}
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef _XOR_CODEC
+#define _XOR_CODEC
+
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "bit_stream.h"
+
+namespace codec {
+
+    inline int leading_zeros(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        return _BitScanReverse64(&index, value) ? 63 - static_cast<int>(index) : 64;
+#else
+        return value == 0 ? 64 : __builtin_clzll(value);
+#endif
+    }
+
+    inline int trailing_zeros(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        return _BitScanForward64(&index, value) ? static_cast<int>(index) : 64;
+#else
+        return value == 0 ? 64 : __builtin_ctzll(value);
+#endif
+    }
+
+    inline uint64_t double_bits(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    inline double bits_double(uint64_t bits) {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    class XorEncoder {
+    public:
+        explicit XorEncoder(BitWriter &writer) : writer(writer), previous(0), leading(-1), trailing(0), first(true) {}
+
+        void add(double value) {
+            auto &&bits = double_bits(value);
+            if (first) {
+                writer.write_bits(bits, 64);
+                previous = bits;
+                first = false;
+                return;
+            }
+            auto &&xored = bits ^ previous;
+            previous = bits;
+            if (xored == 0) {
+                writer.write_bit(false);
+                return;
+            }
+            writer.write_bit(true);
+            auto &&lz = leading_zeros(xored);
+            auto &&tz = trailing_zeros(xored);
+            if (lz > 31) lz = 31;
+            if (leading >= 0 && lz >= leading && tz >= trailing) {
+                writer.write_bit(false);
+                writer.write_bits(xored >> trailing, 64 - leading - trailing);
+                return;
+            }
+            auto &&meaningful = 64 - lz - tz;
+            writer.write_bit(true);
+            writer.write_bits(static_cast<uint64_t>(lz), 5);
+            writer.write_bits(static_cast<uint64_t>(meaningful - 1), 6);
+            writer.write_bits(xored >> tz, meaningful);
+            leading = lz;
+            trailing = tz;
+        }
+
+    private:
+        BitWriter &writer;
+        uint64_t previous;
+        int leading;
+        int trailing;
+        bool first;
+    };
+
+    class XorDecoder {
+    public:
+        explicit XorDecoder(BitReader &reader) : reader(reader), previous(0), leading(0), trailing(0), first(true) {}
+
+        bool next(double &value) {
+            if (first) {
+                if (!reader.read_bits(previous, 64)) return false;
+                first = false;
+                value = bits_double(previous);
+                return true;
+            }
+            bool changed;
+            if (!reader.read_bit(changed)) return false;
+            if (changed) {
+                bool new_window;
+                if (!reader.read_bit(new_window)) return false;
+                if (new_window) {
+                    uint64_t lz, meaningful;
+                    if (!reader.read_bits(lz, 5) || !reader.read_bits(meaningful, 6)) return false;
+                    leading = static_cast<int>(lz);
+                    trailing = 64 - leading - static_cast<int>(meaningful + 1);
+                    if (trailing < 0) return false;
+                }
+                uint64_t xored;
+                if (!reader.read_bits(xored, 64 - leading - trailing)) return false;
+                previous ^= xored << trailing;
+            }
+            value = bits_double(previous);
+            return true;
+        }
+
+    private:
+        BitReader &reader;
+        uint64_t previous;
+        int leading;
+        int trailing;
+        bool first;
+    };
+}
+
+#endif
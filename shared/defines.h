@@ -1,6 +1,9 @@
 #pragma once
-#define MESSAGE_SIZE 512
+#define MESSAGE_SIZE 65535
 #define SERVER_PORT 7777
+#define UDP_PACKET_SIZE 256
+#define PATH_CHUNK_SIZE 1400
+#define MAX_CHUNK_SIZE 16384
 
 // message
 #define MESSAGE_END "\r\n\r\n"
@@ -8,6 +11,7 @@
 #define TXT_PREFIX "txt:"
 #define JSON_PREFIX "jsn:"
 #define ERROR_PREFIX "err:"
+#define BIN_PREFIX "bin:"
 #define MESSAGE_PREFIX_LEN 4
 
 // request
@@ -16,7 +20,17 @@
 #define REQUEST_ADD_CURRENCY_VALUE "ADD_CURRENCY_VALUE"
 #define REQUEST_GET_ALL_CURRENCIES "GET_ALL_CURRENCIES"
 #define REQUEST_GET_CURRENCY_HISTORY "GET_CURRENCY_HISTORY"
+#define REQUEST_GET_CHANGES "GET_CHANGES"
+#define REQUEST_GET_SNAPSHOT "GET_SNAPSHOT"
+#define REQUEST_EXPORT "EXPORT"
+
+// response encoding
+#define ENCODING_JSON "json"
+#define ENCODING_COMPACT "compact"
 
 #define CHUNK_REQUEST_MESSAGE 64
 #define CHUNK_SUCCESS_MESSAGE 32
 #define CONTENT_MESSAGE 16
+#define CHUNK_SIZE_MESSAGE 8
+#define HELLO_MESSAGE 4
+#define COOKIE_MESSAGE 2
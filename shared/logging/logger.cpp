@@ -1,4 +1,19 @@
 #include "logger.h"
 
+std::shared_ptr<spdlog::logger> create_logger() {
+    auto &&logger = std::make_shared<spdlog::async_logger>(
+            "server_logger",
+            spdlog::sinks::stdout_sink_st::instance(),
+            LOGGER_QUEUE_SIZE,
+            spdlog::async_overflow_policy::discard_log_msg,
+            nullptr,
+            std::chrono::milliseconds(LOGGER_FLUSH_INTERVAL_MS));
+#if LOGGER_ACTIVE_LEVEL < LOGGER_LEVEL_INFO
+    logger->set_level(static_cast<spdlog::level::level_enum>(LOGGER_ACTIVE_LEVEL));
+#endif
+    return logger;
+}
+
 //std::shared_ptr<spdlog::logger> Logger::logger_inst = spdlog::basic_logger_mt("server_logger", "server_log.txt");
-std::shared_ptr<spdlog::logger> Logger::logger_inst = spdlog::stdout_logger_mt("server_logger");
+std::shared_ptr<spdlog::logger> Logger::logger_inst = create_logger();
+std::atomic<uint32_t> Logger::sample_rate(LOGGER_DEFAULT_SAMPLE_RATE);
@@ -1,10 +1,50 @@
 #ifndef _LOGGER
 #define _LOGGER
+#include <atomic>
 #include <spdlog/spdlog.h>
 
+#define LOGGER_LEVEL_TRACE 0
+#define LOGGER_LEVEL_DEBUG 1
+#define LOGGER_LEVEL_INFO 2
+#define LOGGER_LEVEL_OFF 6
+
+#ifndef LOGGER_ACTIVE_LEVEL
+#define LOGGER_ACTIVE_LEVEL LOGGER_LEVEL_INFO
+#endif
+
+#define LOGGER_QUEUE_SIZE 8192
+#define LOGGER_FLUSH_INTERVAL_MS 500
+#define LOGGER_DEFAULT_SAMPLE_RATE 64
+
 class Logger {
 public:
     static std::shared_ptr<spdlog::logger> logger_inst;
 
+    static std::atomic<uint32_t> sample_rate;
+
+    static bool sampled() {
+        thread_local uint32_t counter = 0;
+        auto &&rate = sample_rate.load(std::memory_order_relaxed);
+        return rate != 0 && ++counter % rate == 0;
+    }
 };
+
+#if LOGGER_ACTIVE_LEVEL <= LOGGER_LEVEL_TRACE
+#define LOG_TRACE(...) Logger::logger_inst->trace(__VA_ARGS__)
+#else
+#define LOG_TRACE(...) (void)0
+#endif
+
+#if LOGGER_ACTIVE_LEVEL <= LOGGER_LEVEL_DEBUG
+#define LOG_DEBUG(...) Logger::logger_inst->debug(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) (void)0
+#endif
+
+#if LOGGER_ACTIVE_LEVEL <= LOGGER_LEVEL_INFO
+#define LOG_SAMPLED(...) do { if (Logger::sampled()) Logger::logger_inst->info(__VA_ARGS__); } while (0)
+#else
+#define LOG_SAMPLED(...) (void)0
+#endif
+
 #endif
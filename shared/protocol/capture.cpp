@@ -0,0 +1,31 @@
+#include "capture.h"
+#include "codec/binary_io.h"
+
+void protocol::write_capture_header(std::string &out) {
+    codec::write_pod(out, static_cast<uint32_t>(CAPTURE_MAGIC));
+    codec::write_pod(out, static_cast<uint32_t>(CAPTURE_VERSION));
+}
+
+void protocol::write_capture_record(std::string &out, uint64_t time, int64_t client_id, uint8_t direction,
+                                    std::string_view data) {
+    codec::write_pod(out, time);
+    codec::write_pod(out, client_id);
+    codec::write_pod(out, direction);
+    codec::write_string(out, data);
+}
+
+bool protocol::read_capture_header(std::string_view &in) {
+    uint32_t magic, version;
+    if (!codec::read_pod(in, magic) || !codec::read_pod(in, version)) return false;
+    return magic == CAPTURE_MAGIC && version == CAPTURE_VERSION;
+}
+
+bool protocol::read_capture_record(std::string_view &in, CaptureRecord &record) {
+    auto rest = in;
+    if (!codec::read_pod(rest, record.time) || !codec::read_pod(rest, record.client_id) ||
+        !codec::read_pod(rest, record.direction) || !codec::read_string(rest, record.data)) {
+        return false;
+    }
+    in = rest;
+    return true;
+}
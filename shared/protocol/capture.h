@@ -0,0 +1,35 @@
+#ifndef _CAPTURE
+#define _CAPTURE
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#define CAPTURE_MAGIC 0x50414355u
+#define CAPTURE_VERSION 2
+#define CAPTURE_IN 0
+#define CAPTURE_OUT 1
+
+namespace protocol {
+
+    // One datagram the server received or sent. time is in microseconds since the capture
+    // started, client_id is the server session id of the peer.
+    struct CaptureRecord {
+        uint64_t time = 0;
+        int64_t client_id = 0;
+        uint8_t direction = CAPTURE_IN;
+        std::string_view data;
+    };
+
+    void write_capture_header(std::string &out);
+
+    void write_capture_record(std::string &out, uint64_t time, int64_t client_id, uint8_t direction,
+                              std::string_view data);
+
+    bool read_capture_header(std::string_view &in);
+
+    // False at the end of the capture or at a truncated record.
+    bool read_capture_record(std::string_view &in, CaptureRecord &record);
+}
+
+#endif
@@ -0,0 +1,60 @@
+#include "changes.h"
+#include "defines.h"
+#include "json_writer.h"
+#include "json/src/json.hpp"
+
+// Changes are sent as arrays rather than objects to keep a full batch in a few chunks.
+std::string protocol::changes_message(const ChangeBatch &batch) {
+    std::string message = JSON_PREFIX;
+    JsonWriter writer(message);
+    writer.begin_object();
+    writer.key("changes");
+    writer.begin_array();
+    for (auto &&change: batch.changes) {
+        writer.begin_array();
+        writer.value(change.sequence);
+        writer.value(static_cast<uint64_t>(change.op));
+        writer.value(change.currency);
+        writer.value(change.value);
+        writer.value(change.time);
+        writer.value(change.inc_rel);
+        writer.value(change.inc_abs);
+        writer.value(change.date);
+        writer.end_array();
+    }
+    writer.end_array();
+    writer.key("epoch");
+    writer.value(batch.epoch);
+    writer.key("head");
+    writer.value(batch.head);
+    writer.key("truncated");
+    writer.value(batch.truncated);
+    writer.end_object();
+    message.append(MESSAGE_END);
+    return message;
+}
+
+bool protocol::parse_changes(std::string_view body, ChangeBatch &batch) {
+    try {
+        auto &&message = nlohmann::json::parse(body.begin(), body.end());
+        batch.epoch = message.at("epoch").get<uint64_t>();
+        batch.head = message.at("head").get<uint64_t>();
+        batch.truncated = message.at("truncated").get<bool>();
+        batch.changes.clear();
+        for (auto &&item: message.at("changes")) {
+            Change change;
+            change.sequence = item.at(0).get<uint64_t>();
+            change.op = item.at(1).get<uint8_t>();
+            change.currency = item.at(2).get<std::string>();
+            change.value = item.at(3).get<double>();
+            change.time = item.at(4).get<int64_t>();
+            change.inc_rel = item.at(5).get<double>();
+            change.inc_abs = item.at(6).get<double>();
+            change.date = item.at(7).get<int64_t>();
+            batch.changes.emplace_back(std::move(change));
+        }
+    } catch (nlohmann::json::exception &ex) {
+        return false;
+    }
+    return true;
+}
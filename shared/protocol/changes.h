@@ -0,0 +1,41 @@
+#ifndef _CHANGES
+#define _CHANGES
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define CHANGE_ADD_CURRENCY 1
+#define CHANGE_ADD_CURRENCY_VALUE 2
+#define CHANGE_DEL_CURRENCY 3
+
+namespace protocol {
+
+    // One write accepted by the primary. time is the primary clock in milliseconds. An added
+    // value carries the whole row the primary stored, with date in seconds.
+    struct Change {
+        uint64_t sequence = 0;
+        uint8_t op = 0;
+        std::string currency;
+        double value = 0;
+        int64_t time = 0;
+        double inc_rel = 0;
+        double inc_abs = 0;
+        int64_t date = 0;
+    };
+
+    // epoch identifies the primary's log: sequences restart when the primary does.
+    struct ChangeBatch {
+        uint64_t epoch = 0;
+        uint64_t head = 0;
+        bool truncated = false;
+        std::vector<Change> changes;
+    };
+
+    std::string changes_message(const ChangeBatch &batch);
+
+    bool parse_changes(std::string_view body, ChangeBatch &batch);
+}
+
+#endif
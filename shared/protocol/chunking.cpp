@@ -0,0 +1,97 @@
+#include <cstring>
+#include "chunking.h"
+#include "defines.h"
+
+// Layout: u8 type, u16 sequence, i32 number, then i32 total and the payload for content.
+void protocol::split_message(std::string_view message, size_t chunk_size, uint16_t sequence,
+                             std::vector<std::string> &chunks) {
+    chunks.clear();
+    auto total = static_cast<int32_t>(message.size() / chunk_size + (message.size() % chunk_size != 0));
+    if (total == 0) total = 1;
+    chunks.reserve(total);
+    for (int32_t i = 0; i < total; ++i) {
+        auto &&chunk = message.substr(i * chunk_size, chunk_size);
+        std::string packet(CHUNK_HEADER_SIZE + chunk.size(), '\0');
+        packet[0] = CONTENT_MESSAGE;
+        std::memcpy(&packet[1], &sequence, sizeof(uint16_t));
+        std::memcpy(&packet[1 + sizeof(uint16_t)], &i, sizeof(int32_t));
+        std::memcpy(&packet[CHUNK_STATUS_SIZE], &total, sizeof(int32_t));
+        std::memcpy(&packet[CHUNK_HEADER_SIZE], chunk.data(), chunk.size());
+        chunks.emplace_back(std::move(packet));
+    }
+}
+
+std::string protocol::status_packet(char type, int32_t number, uint16_t sequence) {
+    std::string packet(CHUNK_STATUS_SIZE, '\0');
+    packet[0] = type;
+    std::memcpy(&packet[1], &sequence, sizeof(uint16_t));
+    std::memcpy(&packet[1 + sizeof(uint16_t)], &number, sizeof(int32_t));
+    return packet;
+}
+
+bool protocol::sequence_newer(uint16_t a, uint16_t b) {
+    return static_cast<int16_t>(static_cast<uint16_t>(a - b)) > 0;
+}
+
+int32_t protocol::negotiate_chunk_size(int32_t requested) {
+    if (requested < UDP_PACKET_SIZE) return UDP_PACKET_SIZE;
+    if (requested > MAX_CHUNK_SIZE) return MAX_CHUNK_SIZE;
+    return requested;
+}
+
+void protocol::segment_batches(const std::vector<std::string> &packets, std::vector<SegmentBatch> &batches) {
+    batches.clear();
+    for (auto &&packet: packets) {
+        auto &&batch_full = batches.empty() ||
+                            batches.back().count == SEGMENT_BATCH_COUNT ||
+                            batches.back().data.size() % batches.back().segment_size != 0 ||
+                            packet.size() > batches.back().segment_size ||
+                            batches.back().data.size() + packet.size() > SEGMENT_BATCH_BYTES;
+        if (batch_full) {
+            batches.emplace_back();
+            batches.back().segment_size = packet.size();
+        }
+        batches.back().data += packet;
+        ++batches.back().count;
+    }
+}
+
+bool protocol::parse_packet(const char *data, size_t size, ChunkHeader &header, std::string_view &payload) {
+    if (size < CHUNK_STATUS_SIZE) return false;
+    header.type = data[0];
+    std::memcpy(&header.sequence, data + 1, sizeof(uint16_t));
+    std::memcpy(&header.number, data + 1 + sizeof(uint16_t), sizeof(int32_t));
+    header.total = 0;
+    payload = std::string_view();
+    if (header.type == CHUNK_REQUEST_MESSAGE || header.type == CHUNK_SUCCESS_MESSAGE ||
+        header.type == CHUNK_SIZE_MESSAGE) {
+        return true;
+    }
+    if (header.type != CONTENT_MESSAGE || size < CHUNK_HEADER_SIZE) return false;
+    std::memcpy(&header.total, data + CHUNK_STATUS_SIZE, sizeof(int32_t));
+    if (header.number < 0 || header.total <= 0 || header.number >= header.total) return false;
+    payload = std::string_view(data + CHUNK_HEADER_SIZE, size - CHUNK_HEADER_SIZE);
+    return true;
+}
+
+protocol::ChunkStatus protocol::add_chunk(std::vector<std::string> &buffer, int32_t number, int32_t total,
+                                          std::string_view payload) {
+    if (number == 0) {
+        buffer.clear();
+    }
+    auto expected = static_cast<int32_t>(buffer.size());
+    if (number < expected) return ChunkStatus::STALE;
+    if (number > expected) return ChunkStatus::MISSING;
+    buffer.emplace_back(payload);
+    if (expected + 1 == total) return ChunkStatus::COMPLETE;
+    return ChunkStatus::ACCEPTED;
+}
+
+std::string protocol::join_chunks(const std::vector<std::string> &buffer) {
+    size_t size = 0;
+    for (auto &&chunk: buffer) size += chunk.size();
+    std::string message;
+    message.reserve(size);
+    for (auto &&chunk: buffer) message += chunk;
+    return message;
+}
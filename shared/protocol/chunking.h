@@ -0,0 +1,59 @@
+#ifndef _CHUNKING
+#define _CHUNKING
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define CHUNK_STATUS_SIZE (1 + sizeof(uint16_t) + sizeof(int32_t))
+#define CHUNK_HEADER_SIZE (CHUNK_STATUS_SIZE + sizeof(int32_t))
+#define SEGMENT_BATCH_BYTES 60000
+#define SEGMENT_BATCH_COUNT 64
+
+namespace protocol {
+
+    // sequence numbers the requests of a session; chunks and status packets of an answer
+    // carry the sequence of the request they answer.
+    struct ChunkHeader {
+        char type;
+        uint16_t sequence;
+        int32_t number;
+        int32_t total;
+    };
+
+    // Consecutive packets sent in one segmentation offload call. Every packet except the
+    // last one has segment_size bytes.
+    struct SegmentBatch {
+        std::string data;
+        size_t segment_size = 0;
+        size_t count = 0;
+    };
+
+    enum class ChunkStatus {
+        STALE,
+        MISSING,
+        ACCEPTED,
+        COMPLETE
+    };
+
+    void split_message(std::string_view message, size_t chunk_size, uint16_t sequence,
+                       std::vector<std::string> &chunks);
+
+    std::string status_packet(char type, int32_t number, uint16_t sequence = 0);
+
+    // Sequence numbers wrap around, a is newer than b when it is less than half the range ahead.
+    bool sequence_newer(uint16_t a, uint16_t b);
+
+    int32_t negotiate_chunk_size(int32_t requested);
+
+    void segment_batches(const std::vector<std::string> &packets, std::vector<SegmentBatch> &batches);
+
+    bool parse_packet(const char *data, size_t size, ChunkHeader &header, std::string_view &payload);
+
+    ChunkStatus add_chunk(std::vector<std::string> &buffer, int32_t number, int32_t total, std::string_view payload);
+
+    std::string join_chunks(const std::vector<std::string> &buffer);
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include <cstring>
+#include "handshake.h"
+#include "defines.h"
+
+namespace {
+    inline uint64_t rotate(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline void sip_round(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3) {
+        v0 += v1;
+        v1 = rotate(v1, 13);
+        v1 ^= v0;
+        v0 = rotate(v0, 32);
+        v2 += v3;
+        v3 = rotate(v3, 16);
+        v3 ^= v2;
+        v0 += v3;
+        v3 = rotate(v3, 21);
+        v3 ^= v0;
+        v2 += v1;
+        v1 = rotate(v1, 17);
+        v1 ^= v2;
+        v2 = rotate(v2, 32);
+    }
+
+    uint64_t cookie_mac(const protocol::CookieKey &key, uint32_t address, uint16_t port, uint32_t epoch) {
+        char message[sizeof(address) + sizeof(port) + sizeof(epoch)];
+        std::memcpy(message, &address, sizeof(address));
+        std::memcpy(message + sizeof(address), &port, sizeof(port));
+        std::memcpy(message + sizeof(address) + sizeof(port), &epoch, sizeof(epoch));
+        return protocol::siphash(key, message, sizeof(message));
+    }
+}
+
+// SipHash-2-4, words read in host order.
+uint64_t protocol::siphash(const CookieKey &key, const void *data, size_t size) {
+    uint64_t v0 = 0x736f6d6570736575ull ^ key.k0;
+    uint64_t v1 = 0x646f72616e646f6dull ^ key.k1;
+    uint64_t v2 = 0x6c7967656e657261ull ^ key.k0;
+    uint64_t v3 = 0x7465646279746573ull ^ key.k1;
+    auto &&bytes = static_cast<const unsigned char *>(data);
+    auto &&full = size - size % 8;
+    for (size_t offset = 0; offset < full; offset += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + offset, sizeof(word));
+        v3 ^= word;
+        sip_round(v0, v1, v2, v3);
+        sip_round(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+    uint64_t last = static_cast<uint64_t>(size) << 56;
+    for (size_t i = full; i < size; ++i) {
+        last |= static_cast<uint64_t>(bytes[i]) << (8 * (i - full));
+    }
+    v3 ^= last;
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; ++i) sip_round(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint32_t protocol::cookie_epoch(int64_t now) {
+    return static_cast<uint32_t>(now / COOKIE_EPOCH_SECONDS);
+}
+
+std::string protocol::cookie_packet(const CookieKey &key, uint32_t address, uint16_t port, uint32_t epoch) {
+    std::string packet(COOKIE_PACKET_SIZE, '\0');
+    auto &&mac = cookie_mac(key, address, port, epoch);
+    packet[0] = COOKIE_MESSAGE;
+    std::memcpy(&packet[1], &epoch, sizeof(epoch));
+    std::memcpy(&packet[1 + sizeof(epoch)], &mac, sizeof(mac));
+    return packet;
+}
+
+bool protocol::check_cookie(const CookieKey &key, const char *data, size_t size, uint32_t address, uint16_t port,
+                            uint32_t epoch) {
+    if (size != COOKIE_PACKET_SIZE || data[0] != COOKIE_MESSAGE) return false;
+    uint32_t issued;
+    uint64_t mac;
+    std::memcpy(&issued, data + 1, sizeof(issued));
+    std::memcpy(&mac, data + 1 + sizeof(issued), sizeof(mac));
+    if (issued != epoch && issued + 1 != epoch) return false;
+    return mac == cookie_mac(key, address, port, issued);
+}
+
+std::string protocol::hello_packet() {
+    std::string packet(COOKIE_PACKET_SIZE, '\0');
+    packet[0] = HELLO_MESSAGE;
+    return packet;
+}
+
+bool protocol::handshake_packet(const char *data, size_t size) {
+    return size == COOKIE_PACKET_SIZE && (data[0] == HELLO_MESSAGE || data[0] == COOKIE_MESSAGE);
+}
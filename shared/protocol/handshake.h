@@ -0,0 +1,36 @@
+#ifndef _HANDSHAKE
+#define _HANDSHAKE
+
+#include <cstdint>
+#include <string>
+
+#define COOKIE_PACKET_SIZE (1 + sizeof(uint32_t) + sizeof(uint64_t))
+#define COOKIE_EPOCH_SECONDS 30
+
+namespace protocol {
+
+    struct CookieKey {
+        uint64_t k0;
+        uint64_t k1;
+    };
+
+    uint64_t siphash(const CookieKey &key, const void *data, size_t size);
+
+    uint32_t cookie_epoch(int64_t now);
+
+    // A cookie is the epoch it was issued in and a SipHash of the peer address, port and
+    // epoch, so the server can check it without keeping anything per peer.
+    std::string cookie_packet(const CookieKey &key, uint32_t address, uint16_t port, uint32_t epoch);
+
+    // Accepts cookies of the current and the previous epoch.
+    bool check_cookie(const CookieKey &key, const char *data, size_t size, uint32_t address, uint16_t port,
+                      uint32_t epoch);
+
+    // The first packet of a client, as long as the cookie so answering it sends no more than was received.
+    std::string hello_packet();
+
+    // Whether the packet has the shape of a hello or of an echoed cookie.
+    bool handshake_packet(const char *data, size_t size);
+}
+
+#endif
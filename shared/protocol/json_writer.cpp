@@ -0,0 +1,149 @@
+#include "json_writer.h"
+#include <charconv>
+#include <cmath>
+
+void protocol::JsonWriter::separate() {
+    if (after_key) {
+        after_key = false;
+        return;
+    }
+    if (depth == 0) return;
+    auto &&bit = uint64_t(1) << (depth - 1);
+    if (has_items & bit) out.push_back(',');
+    has_items |= bit;
+}
+
+void protocol::JsonWriter::open(char bracket) {
+    separate();
+    out.push_back(bracket);
+    ++depth;
+    has_items &= ~(uint64_t(1) << (depth - 1));
+}
+
+void protocol::JsonWriter::close(char bracket) {
+    out.push_back(bracket);
+    --depth;
+}
+
+void protocol::JsonWriter::begin_object() {
+    open('{');
+}
+
+void protocol::JsonWriter::end_object() {
+    close('}');
+}
+
+void protocol::JsonWriter::begin_array() {
+    open('[');
+}
+
+void protocol::JsonWriter::end_array() {
+    close(']');
+}
+
+void protocol::JsonWriter::key(std::string_view name) {
+    value(name);
+    out.push_back(':');
+    after_key = true;
+}
+
+void protocol::JsonWriter::value(std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    separate();
+    out.push_back('"');
+    for (auto &&symbol: text) {
+        auto &&code = static_cast<unsigned char>(symbol);
+        switch (symbol) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\b': out.append("\\b"); break;
+            case '\f': out.append("\\f"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            default:
+                if (code < 0x20) {
+                    out.append("\\u00");
+                    out.push_back(hex[code >> 4]);
+                    out.push_back(hex[code & 0xf]);
+                } else {
+                    out.push_back(symbol);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+// Takes the shortest round-trip digits and lays them out the way nlohmann does: plain
+// notation for decimal exponents between -4 and 15, scientific with two exponent digits
+// otherwise, and ".0" on integral values.
+void protocol::JsonWriter::value(double number) {
+    if (!std::isfinite(number)) return null();
+    separate();
+    if (std::signbit(number)) out.push_back('-');
+    if (number == 0) {
+        out.append("0.0");
+        return;
+    }
+    char buffer[32];
+    auto &&end = std::to_chars(buffer, buffer + sizeof(buffer), std::fabs(number), std::chars_format::scientific).ptr;
+    char digits[24];
+    int count = 0;
+    auto position = buffer;
+    for (; position != end && *position != 'e'; ++position) {
+        if (*position != '.') digits[count++] = *position;
+    }
+    int exponent = 0;
+    std::from_chars(position + (position[1] == '+' ? 2 : 1), end, exponent);
+    auto &&point = exponent + 1;
+    if (count <= point && point <= 15) {
+        out.append(digits, count);
+        out.append(point - count, '0');
+        out.append(".0");
+    } else if (0 < point && point <= 15) {
+        out.append(digits, point);
+        out.push_back('.');
+        out.append(digits + point, count - point);
+    } else if (-4 < point && point <= 0) {
+        out.append("0.");
+        out.append(-point, '0');
+        out.append(digits, count);
+    } else {
+        out.push_back(digits[0]);
+        if (count > 1) {
+            out.push_back('.');
+            out.append(digits + 1, count - 1);
+        }
+        out.push_back('e');
+        out.push_back(exponent < 0 ? '-' : '+');
+        auto &&magnitude = exponent < 0 ? -exponent : exponent;
+        if (magnitude < 10) out.push_back('0');
+        char exponent_buffer[8];
+        auto &&exponent_end = std::to_chars(exponent_buffer, exponent_buffer + sizeof(exponent_buffer), magnitude).ptr;
+        out.append(exponent_buffer, exponent_end - exponent_buffer);
+    }
+}
+
+void protocol::JsonWriter::value(int64_t number) {
+    separate();
+    char buffer[24];
+    auto &&end = std::to_chars(buffer, buffer + sizeof(buffer), number).ptr;
+    out.append(buffer, end - buffer);
+}
+
+void protocol::JsonWriter::value(uint64_t number) {
+    separate();
+    char buffer[24];
+    auto &&end = std::to_chars(buffer, buffer + sizeof(buffer), number).ptr;
+    out.append(buffer, end - buffer);
+}
+
+void protocol::JsonWriter::value(bool flag) {
+    separate();
+    out.append(flag ? "true" : "false");
+}
+
+void protocol::JsonWriter::null() {
+    separate();
+    out.append("null");
+}
@@ -0,0 +1,59 @@
+#ifndef _JSON_WRITER
+#define _JSON_WRITER
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace protocol {
+
+    // Appends JSON text straight to a string without building a document first. The caller
+    // pairs the begin and end calls and writes keys inside objects; separators are added here.
+    // Values are laid out like nlohmann::json::dump(), so keys written in sorted order match
+    // the dump of the equivalent document, except that doubles get the shortest digits that
+    // read back exactly, which is now and then one digit less. Nesting is limited to 64 levels.
+    class JsonWriter {
+    public:
+        explicit JsonWriter(std::string &target) : out(target), depth(0), has_items(0), after_key(false) {}
+
+        void begin_object();
+
+        void end_object();
+
+        void begin_array();
+
+        void end_array();
+
+        void key(std::string_view name);
+
+        void value(std::string_view text);
+
+        void value(const char *text) {
+            value(std::string_view(text));
+        }
+
+        void value(double number);
+
+        void value(int64_t number);
+
+        void value(uint64_t number);
+
+        void value(bool flag);
+
+        void null();
+
+    private:
+        void separate();
+
+        void open(char bracket);
+
+        void close(char bracket);
+
+        std::string &out;
+        int depth;
+        uint64_t has_items;
+        bool after_key;
+    };
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "request.h"
+#include <charconv>
+#include "defines.h"
+#include "json/src/json.hpp"
+
+protocol::RequestType protocol::request_type(std::string_view name) {
+    if (name == REQUEST_ADD_CURRENCY) return RequestType::ADD_CURRENCY;
+    if (name == REQUEST_ADD_CURRENCY_VALUE) return RequestType::ADD_CURRENCY_VALUE;
+    if (name == REQUEST_DEL_CURRENCY) return RequestType::DEL_CURRENCY;
+    if (name == REQUEST_GET_ALL_CURRENCIES) return RequestType::GET_ALL_CURRENCIES;
+    if (name == REQUEST_GET_CURRENCY_HISTORY) return RequestType::GET_CURRENCY_HISTORY;
+    if (name == REQUEST_GET_CHANGES) return RequestType::GET_CHANGES;
+    if (name == REQUEST_GET_SNAPSHOT) return RequestType::GET_SNAPSHOT;
+    if (name == REQUEST_EXPORT) return RequestType::EXPORT;
+    return RequestType::UNKNOWN;
+}
+
+namespace {
+    // Reads the flat objects our clients send in one pass. Anything it does not expect
+    // (escapes, non-ASCII text, unknown keys, nested values) makes it give up, and the
+    // request is parsed again by nlohmann, so it only has to be right for the common shape.
+    class FastParser {
+    public:
+        explicit FastParser(std::string_view text) : position(text.data()), end(text.data() + text.size()) {}
+
+        bool parse(protocol::Request &request) {
+            auto has_type = false;
+            if (!consume('{')) return false;
+            if (consume('}')) return false;
+            do {
+                std::string_view key;
+                if (!string(key) || !consume(':')) return false;
+                if (key == "type") {
+                    std::string_view type;
+                    if (!string(type)) return false;
+                    request.type = protocol::request_type(type);
+                    has_type = true;
+                } else if (key == "currency") {
+                    if (!string(request.currency)) return false;
+                } else if (key == "value") {
+                    if (!number(request.value)) return false;
+                } else if (key == "since") {
+                    if (!number(request.since)) return false;
+                } else if (key == "encoding") {
+                    if (!string(request.encoding)) return false;
+                } else if (key == "format") {
+                    if (!string(request.format)) return false;
+                } else if (key == "name") {
+                    if (!string(request.name)) return false;
+                } else if (key == "currencies") {
+                    if (!string_array(request.currencies)) return false;
+                } else {
+                    return false;
+                }
+            } while (consume(','));
+            if (!consume('}')) return false;
+            skip_space();
+            return has_type && position == end;
+        }
+
+    private:
+        void skip_space() {
+            while (position != end && (*position == ' ' || *position == '\t' || *position == '\n' || *position == '\r')) {
+                ++position;
+            }
+        }
+
+        bool consume(char symbol) {
+            skip_space();
+            if (position == end || *position != symbol) return false;
+            ++position;
+            return true;
+        }
+
+        bool string(std::string_view &text) {
+            if (!consume('"')) return false;
+            const char *start = position;
+            while (position != end && *position != '"') {
+                auto &&code = static_cast<unsigned char>(*position);
+                if (code == '\\' || code < 0x20 || code >= 0x80) return false;
+                ++position;
+            }
+            if (position == end) return false;
+            text = std::string_view(start, position - start);
+            ++position;
+            return true;
+        }
+
+        bool string(std::string &text) {
+            std::string_view view;
+            if (!string(view)) return false;
+            text.assign(view.data(), view.size());
+            return true;
+        }
+
+        bool string_array(std::vector<std::string> &items) {
+            items.clear();
+            if (!consume('[')) return false;
+            if (consume(']')) return true;
+            do {
+                std::string_view item;
+                if (!string(item)) return false;
+                items.emplace_back(item);
+            } while (consume(','));
+            return consume(']');
+        }
+
+        bool digits(const char *&cursor) {
+            const char *first = cursor;
+            while (cursor != end && *cursor >= '0' && *cursor <= '9') ++cursor;
+            return cursor != first;
+        }
+
+        // The text is checked against the JSON grammar first, since from_chars also takes
+        // forms like "1." or "inf". Integers reject fractions and signs they cannot hold.
+        template<typename T>
+        bool number(T &result) {
+            skip_space();
+            const char *cursor = position;
+            if (cursor != end && *cursor == '-') ++cursor;
+            const char *integer_start = cursor;
+            if (!digits(cursor) || (*integer_start == '0' && cursor - integer_start > 1)) return false;
+            if (cursor != end && *cursor == '.') {
+                ++cursor;
+                if (!digits(cursor)) return false;
+            }
+            if (cursor != end && (*cursor == 'e' || *cursor == 'E')) {
+                ++cursor;
+                if (cursor != end && (*cursor == '+' || *cursor == '-')) ++cursor;
+                if (!digits(cursor)) return false;
+            }
+            auto &&parsed = std::from_chars(position, cursor, result);
+            if (parsed.ec != std::errc() || parsed.ptr != cursor) return false;
+            position = cursor;
+            return true;
+        }
+
+        const char *position;
+        const char *end;
+    };
+}
+
+int protocol::parse_request(std::string_view json_string, Request &request) {
+    if (FastParser(json_string).parse(request)) return 0;
+    request = Request();
+    try {
+        auto &&request_json = nlohmann::json::parse(json_string.begin(), json_string.end());
+        request.type = request_type(request_json.at("type").get<std::string>());
+        auto &&currency = request_json.find("currency");
+        if (currency != request_json.end()) request.currency = currency->get<std::string>();
+        auto &&value = request_json.find("value");
+        if (value != request_json.end()) request.value = value->get<double>();
+        auto &&encoding = request_json.find("encoding");
+        if (encoding != request_json.end()) request.encoding = encoding->get<std::string>();
+        auto &&since = request_json.find("since");
+        if (since != request_json.end()) request.since = since->get<uint64_t>();
+        auto &&format = request_json.find("format");
+        if (format != request_json.end()) request.format = format->get<std::string>();
+        auto &&name = request_json.find("name");
+        if (name != request_json.end()) request.name = name->get<std::string>();
+        auto &&currencies = request_json.find("currencies");
+        if (currencies != request_json.end()) request.currencies = currencies->get<std::vector<std::string>>();
+    } catch (nlohmann::json::exception &ex) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef _REQUEST
+#define _REQUEST
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace protocol {
+
+    enum class RequestType {
+        UNKNOWN,
+        ADD_CURRENCY,
+        ADD_CURRENCY_VALUE,
+        DEL_CURRENCY,
+        GET_ALL_CURRENCIES,
+        GET_CURRENCY_HISTORY,
+        GET_CHANGES,
+        GET_SNAPSHOT,
+        EXPORT,
+    };
+
+    struct Request {
+        RequestType type = RequestType::UNKNOWN;
+        std::string currency;
+        double value = 0;
+        std::string encoding;
+        uint64_t since = 0;
+        std::string format;
+        std::string name;
+        std::vector<std::string> currencies;
+    };
+
+    RequestType request_type(std::string_view name);
+
+    // A missing "type" is an error, an unknown one parses as RequestType::UNKNOWN.
+    int parse_request(std::string_view json_string, Request &request);
+}
+
+#endif